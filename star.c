@@ -1,5 +1,6 @@
 // Created by: David Achoy, Earl alvarado
 
+#define _GNU_SOURCE // copy_file_range, fallocate, sync_file_range
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,13 +8,31 @@
 #include <stdbool.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
 
 #define MAX_FREE_SPACES 100
+#define COPY_BUFFER_SIZE (1024 * 1024)
+#define MAX_VOLUMES 16
+#define DIRECTORY_CACHE_SIZE 256 // Directorios abiertos que se conservan durante la extracción
+#define SERVE_MAX_ARCHIVES 16 // Archivos que puede mantener abiertos --serve
+#define SERVE_MAX_LINE 1024
+#define CHURN_POOL_SIZE 32 // Nombres distintos que usa el simulador de envejecimiento
+#define CHURN_MAX_FILE_SIZE (64 * 1024)
+#define VOLUME_MANIFEST_MARKER -1 // Valor inicial de un manifiesto de volúmenes en lugar del número de espacios libres
+#define ARCHIVE_FORMAT_MARKER 0x32524154 // Valor inicial de un archivo con permisos y fecha en FileInfo ("TAR2")
 
 // file status enum for file info
 typedef enum {
     ACTIVE,
-    DELETED
+    DELETED,
+    RESERVED // Región reservada por un escritor concurrente, aún sin publicar
 } FileStatus;
 
 // verbose level enum for verbose
@@ -25,6 +44,39 @@ typedef enum {
 
 // Global variables for verbose
 VerboseLevel verbose_level = VERBOSE_NONE;
+// Global variable for concurrent append mode (--concurrent)
+bool concurrent_mode = false;
+// Global variables for multi-volume archives (--volumes, --volume-size, --volume-dirs)
+int num_volumes = 0;
+long volume_size = 0;
+char *volume_dirs = NULL;
+// conflict policy enum for catenate
+typedef enum {
+    CONFLICT_SKIP,    // Conservar el archivo del destino
+    CONFLICT_REPLACE, // Borrar el archivo del destino y añadir el nuevo
+    CONFLICT_RENAME   // Añadir el nuevo con un sufijo numérico
+} ConflictPolicy;
+
+// Global variable for catenate name collisions (--on-conflict)
+ConflictPolicy conflict_policy = CONFLICT_SKIP;
+// Global variables for I/O throttling (--limit-rate, --limit-iops, --drop-cache, --ioprio)
+long rate_limit_bytes = 0;
+long rate_limit_iops = 0;
+bool drop_cache = false;
+char *io_priority = NULL;
+// Global variable for restoring setuid, setgid and sticky bits on extraction (--preserve-permissions)
+bool preserve_permissions = false;
+// Global variable for the process exit status: 1 when an operation failed or --diff found differences
+int exit_status = 0;
+// Global variable for --cat: the standard output carries only member data, messages go to stderr
+bool raw_output = false;
+// Global variable for parallel operations (--threads)
+int num_threads = 1;
+// Global variables for the aging simulator (--steps, --seed, --pack-every, --churn-log)
+int churn_steps = 1000;
+unsigned int churn_seed = 1;
+int churn_pack_interval = 0;
+char *churn_log = NULL;
 
 // Structs for file info, archive metadata and free space info
 typedef struct {
@@ -37,45 +89,239 @@ typedef struct {
     int file_size;
     int start_position;
     FileStatus status;
-
+    mode_t mode; // Permisos del archivo original
+    time_t mtime; // Fecha de modificación del archivo original
 } FileInfo;
+// legacy file info struct, header of archives written before mode and mtime were stored (leading int 0)
+typedef struct {
+    char filename[255];
+    int file_size;
+    int start_position;
+    FileStatus status;
+} LegacyFileInfo;
 // free space info struct
 typedef struct {
     int start_position;
     int size;
 } FreeSpaceInfo;
 
+// volume manifest struct, extends the archive metadata with the list of volumes
+typedef struct {
+    ArchiveMetadata metadata; // Totales de todos los volúmenes
+    int num_volumes;
+    char volume_names[MAX_VOLUMES][255];
+} VolumeManifest;
+// volume task struct, work of one thread over one volume
+typedef struct {
+    const char *volume_name;
+    char **files;
+    int num_files;
+    FileInfo *file_infos;
+    int num_file_infos;
+    bool failed;
+} VolumeTask;
+// directory cache struct, open directories indexed by path to avoid resolving them again
+typedef struct {
+    char paths[DIRECTORY_CACHE_SIZE][255];
+    int fds[DIRECTORY_CACHE_SIZE];
+} DirectoryCache;
+// catenate target struct, state of the destination while members are appended
+typedef struct {
+    int archive_fd;
+    off_t tail_position;
+    FileInfo *file_infos; // Cabeceras del destino y de los archivos ya añadidos
+    off_t *header_positions;
+    int num_file_infos;
+    int capacity;
+    int *index; // Tabla hash de nombre a posición en file_infos, -1 libre
+    int index_size;
+    int added_files;
+    FreeSpaceInfo free_spaces[MAX_FREE_SPACES];
+} CatenateTarget;
+// io throttle struct, token buckets for bytes and operations shared by all threads
+typedef struct {
+    pthread_mutex_t lock;
+    bool started;
+    struct timespec start;
+    struct timespec last_refill;
+    double byte_tokens;
+    double op_tokens;
+    long total_bytes;
+    long total_ops;
+} IoThrottle;
+IoThrottle io_throttle = {PTHREAD_MUTEX_INITIALIZER, false, {0, 0}, {0, 0}, 0, 0, 0, 0};
+// served archive struct, archive kept open by --serve with its active members and free list in memory
+typedef struct {
+    char name[255];
+    FILE *archive;
+    pthread_mutex_t lock;
+    FileInfo *members; // Solo los archivos activos
+    int num_members;
+    int capacity;
+    int *index; // Tabla hash de nombre a posición en members: -1 libre, -2 borrado
+    int index_size;
+    int index_tombstones; // Posiciones -2; cuentan como ocupadas para el factor de carga
+    FreeSpaceInfo free_spaces[MAX_FREE_SPACES];
+    ArchiveMetadata metadata;
+    struct timespec loaded_mtime; // Para detectar cambios hechos por otros procesos
+    off_t loaded_size;
+} ServedArchive;
+// serve client struct, connection handled by one thread
+typedef struct {
+    int client_fd;
+    ServedArchive *archives;
+    int num_archives;
+} ServeClient;
+// churn member struct, expected state of one simulated file
+typedef struct {
+    bool active;
+    int version;
+    int size;
+} ChurnMember;
+// churn stats struct, state of the archive after one simulated step
+typedef struct {
+    long archive_size;
+    long live_bytes;
+    long free_bytes;
+    int free_entries;
+    long leaked_bytes;
+    int errors;
+} ChurnStats;
+// create task struct, work shared by the parallel create threads
+typedef struct {
+    int archive_fd;
+    char **files;
+    FileInfo *file_infos;
+    int num_files;
+    int next_index;
+    bool failed;
+    pthread_mutex_t lock;
+} CreateTask;
+// diff result enum, difference found for one member
+typedef enum {
+    DIFF_NONE,
+    DIFF_MISSING,   // No existe en disco
+    DIFF_SIZE,      // Tamaño distinto
+    DIFF_CONTENT,   // Contenido distinto
+    DIFF_READ_ERROR,// No se pudo leer
+    DIFF_METADATA   // Mismo contenido, permisos o fecha de modificación distintos
+} DiffKind;
+// diff task struct, work shared by the diff threads
+typedef struct {
+    int archive_fd;
+    FileInfo *file_infos;
+    int num_file_infos;
+    DiffKind *kinds;
+    long *values; // Tamaño en disco o posición de la primera diferencia
+    int next_index;
+    pthread_mutex_t lock;
+} DiffTask;
+
+// Tamaño de la cabecera: número de espacios libres, lista de espacios libres y metadata
+#define METADATA_POSITION (sizeof(int) + sizeof(FreeSpaceInfo) * MAX_FREE_SPACES)
+#define HEADER_SIZE (METADATA_POSITION + sizeof(ArchiveMetadata))
 
 // Function prototypes
-void create(const char *archive_name, char *files[], int num_files); // create function            
+bool create(const char *archive_name, char *files[], int num_files); // create function            
 void list(const char *archive_name); // list function
 void extractAll(const char *archive_name); // extract all function
+void extract(const char *archive_name, char *files[], int num_files); // extract selected files function
+void create_volumes(const char *archive_name, char *files[], int num_files); // create multi-volume function
+bool create_parallel(const char *archive_name, char *files[], int num_files); // parallel create function
+void churn(const char *archive_name); // aging simulator function
+int diff(const char *archive_name, char *files[], int num_files); // diff against filesystem function
+int diff_archive(const char *archive_name, char *files[], int num_files, bool matched[]); // diff one archive or volume function
+void catenate(const char *archive_name, char *sources[], int num_sources); // catenate archives function
+bool cat_member(const char *archive_name, const char *member_name, long offset, long length, int out_fd); // read member range function
+bool cat(const char *archive_name, const char *member_spec); // cat member range function
+void serve(const char *socket_path, char *archives[], int num_archives); // archive daemon function
 void delete(const char *archive_name, const char *file_to_delete); // delete function
 void append(const char *archive_name, const char *file_to_add); // append function
+void append_concurrent(const char *archive_name, const char *file_to_add); // concurrent append function
 void pack(const char *archive_name); // pack function
 void defragment(const char *archive_name); // defragment function
 void update(const char *archive_name, const char *file_to_update); // update function
 //auxiliary functions
-bool find_file_info (FILE *archive, const char *file_name, FileInfo *file_info); // find file info function
+bool find_file_info (FILE *archive, const char *file_name, FileInfo *file_info, bool legacy); // find file info function
+bool read_file_info(FILE *archive, FileInfo *file_info, bool legacy); // read one header function
 void showValidOptions(); // show valid options function
 void load_free_spaces(FILE *archive, FreeSpaceInfo free_spaces[MAX_FREE_SPACES]); // load free spaces function
 void save_free_spaces(FILE *archive, FreeSpaceInfo free_spaces[MAX_FREE_SPACES]); // save free spaces function
 void insert_and_combine_free_space(FreeSpaceInfo free_spaces[MAX_FREE_SPACES], FreeSpaceInfo new_space); // insert and combine free space function
 void print_free_spaces(const char *archive_name); // print free spaces function
+void init_directory_cache(DirectoryCache *cache); // init directory cache function
+void close_directory_cache(DirectoryCache *cache); // close directory cache function
+int open_directory(DirectoryCache *cache, const char *path); // open cached directory function
+int open_extract_target(DirectoryCache *cache, const char *filename); // open extraction target function
+int take_free_space(FILE *archive, FreeSpaceInfo free_spaces[MAX_FREE_SPACES], int needed_size, int *entries_delta); // take free space function
+bool lock_archive_header(int archive_fd, short lock_type); // lock archive header function
+bool lock_reserved_region(int archive_fd, const FileInfo *file_info); // lock reserved region function
+bool reservation_in_use(int archive_fd, const FileInfo *file_info); // check reserved region function
+bool copy_range(int in_fd, off_t in_offset, int out_fd, off_t out_offset, off_t length); // copy range function
+bool write_member(FILE *archive, int file_fd, FileInfo *file_info, FreeSpaceInfo free_spaces[MAX_FREE_SPACES]); // write member data and header function
+bool parse_setting_option(const char *option); // parse setting option function
+int load_file_infos(FILE *archive, FileInfo **file_infos, bool legacy); // load file infos function
+bool load_volume_manifest(const char *archive_name, VolumeManifest *manifest); // load volume manifest function
+bool reject_volume_manifest(const char *archive_name); // refuse to modify a manifest function
+bool check_archive_format(int archive_fd, const char *archive_name, bool *legacy); // check format marker function
+void resolve_volume_name(const char *archive_name, const char *stored_name, char resolved_name[255]); // resolve volume name function
+void run_volume_tasks(VolumeTask tasks[], int num_tasks, void *(*task_function)(void *)); // run volume tasks function
+void list_volumes(const VolumeManifest *manifest); // list volumes function
+void *list_volume_task(void *argument); // list volume thread function
+void *extract_volume_task(void *argument); // extract volume thread function
+void *create_volume_task(void *argument); // create volume thread function
+void *create_parallel_task(void *argument); // parallel create thread function
+void *diff_task(void *argument); // diff thread function
+DiffKind diff_member(int archive_fd, const FileInfo *file_info, long *value); // diff one member function
+void catenate_source(CatenateTarget *target, const char *source_name); // catenate one archive function
+int find_catenate_member(const CatenateTarget *target, const char *filename); // find active member function
+void catenate_index_rebuild(CatenateTarget *target); // rebuild catenate name index function
+void catenate_index_add(CatenateTarget *target, int member); // add member to catenate index function
+bool copy_range_kernel(int in_fd, off_t in_offset, int out_fd, off_t out_offset, off_t length); // kernel-side copy function
+bool served_load(ServedArchive *served); // load served archive state function
+void served_refresh(ServedArchive *served); // reload served archive if changed function
+int served_find(const ServedArchive *served, const char *filename); // find served member function
+void served_index_rebuild(ServedArchive *served); // rebuild member index function
+void served_add(ServedArchive *served, const FileInfo *file_info); // add served member function
+void served_remove(ServedArchive *served, int member); // remove served member function
+void serve_request(ServeClient *client, char *line); // handle one request function
+unsigned int hash_name(const char *name); // name hash function
+void *serve_client_task(void *argument); // client connection thread function
+void preallocate_range(int archive_fd, off_t offset, off_t length); // preallocate disk blocks function
+void throttle_io(long bytes); // rate limiter function
+void drop_cached_range(int fd, off_t offset, off_t length); // drop page cache function
+bool apply_io_priority(const char *priority); // io priority function
+void report_io_throughput(FILE *stream); // report throughput function
+void punch_hole(int archive_fd, off_t offset, off_t length); // release disk blocks function
+unsigned char churn_byte(int slot, int version, int offset); // simulated content function
+void churn_write_member(const char *name, int slot, const ChurnMember *member); // write simulated file function
+bool churn_validate(const char *archive_name, const ChurnMember members[CHURN_POOL_SIZE], ChurnStats *stats); // validate archive function
 
 void update(
     const char *archive_name, // Nombre del archivo de destino
     const char *file_to_update // Nombre del archivo a actualizar
 ) {
+    if (reject_volume_manifest(archive_name)) {
+        return;
+    }
     FILE *archive = fopen(archive_name, "rb+");
     if (!archive) {
         printf("Error al abrir el archivo %s\n", archive_name);
         return;
     }
+    if (!check_archive_format(fileno(archive), archive_name, NULL)) {
+        fclose(archive);
+        return;
+    }
+    // Bloquear la cabecera para no interferir con escritores concurrentes
+    if (!lock_archive_header(fileno(archive), F_WRLCK)) {
+        fclose(archive);
+        return;
+    }
 
     // Buscar el archivo a actualizar
     FileInfo file_info;
-    if (!find_file_info(archive, file_to_update, &file_info)) {
+    if (!find_file_info(archive, file_to_update, &file_info, false)) {
         printf("El archivo %s no fue encontrado en el archivo.\n", file_to_update);
         fclose(archive);
         return;
@@ -86,11 +332,6 @@ void update(
         fclose(archive);
         return;
     }
-    // Cambiar el estado a DELETED
-    file_info.status = DELETED;
-    fseek(archive, file_info.start_position - sizeof(FileInfo), SEEK_SET);  // Regresar para actualizar la información
-    fwrite(&file_info, sizeof(FileInfo), 1, archive);
-
     // Abrir el nuevo archivo para obtener su contenido
     FILE *new_file_ptr = fopen(file_to_update, "rb");
     if (!new_file_ptr) {
@@ -109,49 +350,48 @@ void update(
     load_free_spaces(archive, free_spaces);
 
     // Buscar primer espacio libre suficientemente grande usando First Fit
-    int index_found = -1;
-    for (int i = 0; i < MAX_FREE_SPACES; i++) {
-        if (free_spaces[i].size >= new_content_size + sizeof(FileInfo)) {
-            index_found = i;
-            break;
-        }
-    }
-    //imprimir posicion de inicio
-    int start_position;
-    if (index_found != -1) {
-        // Usar el espacio libre encontrado
-        start_position = free_spaces[index_found].start_position;
-        free_spaces[index_found].start_position += new_content_size + sizeof(FileInfo);
-        free_spaces[index_found].size -= (new_content_size + sizeof(FileInfo));
-        if (free_spaces[index_found].size == 0) {
-            memset(&free_spaces[index_found], 0, sizeof(FreeSpaceInfo));
-        }
+    int entries_delta = 1;
+    int start_position = take_free_space(archive, free_spaces, new_content_size + sizeof(FileInfo), &entries_delta);
+    if (start_position != -1) {
         fseek(archive, start_position, SEEK_SET);
     } else {
         fseek(archive, 0, SEEK_END);
         start_position = ftell(archive);
+        preallocate_range(fileno(archive), start_position, new_content_size + sizeof(FileInfo));
     }
 
     // Escribir información del nuevo archivo en el archivo de destino
     FileInfo new_file_info;
+    memset(&new_file_info, 0, sizeof(FileInfo));
     strncpy(new_file_info.filename, file_to_update, 255);
     new_file_info.filename[255 - 1] = '\0';
     new_file_info.file_size = new_content_size;
     new_file_info.status = ACTIVE;
     new_file_info.start_position = start_position + sizeof(FileInfo);
-    fwrite(&new_file_info, sizeof(FileInfo), 1, archive);
-
-    // Escribir contenido del archivo en el archivo de destino
-    char *buffer = malloc(new_content_size);
-    fread(buffer, new_content_size, 1, new_file_ptr);
-    fwrite(buffer, new_content_size, 1, archive);
-    free(buffer);
+    struct stat new_file_stat;
+    fstat(fileno(new_file_ptr), &new_file_stat);
+    new_file_info.mode = new_file_stat.st_mode & 07777;
+    new_file_info.mtime = new_file_stat.st_mtime;
+    bool written = write_member(archive, fileno(new_file_ptr), &new_file_info, free_spaces);
+
+    // Solo con la nueva versión ya copiada, la anterior se marca como DELETED, pasa a ser espacio libre
+    // y sus bloques se devuelven al sistema de archivos; si la copia falla, la anterior sigue activa
+    if (written) {
+        file_info.status = DELETED;
+        fseek(archive, file_info.start_position - sizeof(FileInfo), SEEK_SET);  // Regresar para actualizar la información
+        fwrite(&file_info, sizeof(FileInfo), 1, archive);
+        FreeSpaceInfo old_space;
+        old_space.start_position = file_info.start_position - sizeof(FileInfo);
+        old_space.size = file_info.file_size + sizeof(FileInfo);
+        insert_and_combine_free_space(free_spaces, old_space);
+        punch_hole(fileno(archive), file_info.start_position, file_info.file_size);
+    }
 
     // Actualizar metadatos y espacios libres
     fseek(archive, sizeof(int) + sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, SEEK_SET);
     ArchiveMetadata metadata;
     fread(&metadata, sizeof(ArchiveMetadata), 1, archive);
-    metadata.num_files++;
+    metadata.num_files += entries_delta;
     fseek(archive, sizeof(int) + sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, SEEK_SET);
     fwrite(&metadata, sizeof(ArchiveMetadata), 1, archive);
 
@@ -160,28 +400,35 @@ void update(
     // Cerrar archivos
     fclose(new_file_ptr);
     fclose(archive);
-    printf("El archivo %s ha sido actualizado.\n", file_to_update);
+    if (written) {
+        printf("El archivo %s ha sido actualizado.\n", file_to_update);
+    }
 }
 
 // create function
-void create(
+bool create(
     const char *archive_name,  // Nombre del archivo de destino
     char *files[],             // Arreglo de nombres de archivos para incluir en el archivo
     int num_files              // Número de archivos en el arreglo
 ) {
+    // Con --threads la disposición se calcula antes y los archivos se copian en paralelo
+    if (num_threads > 1) {
+        return create_parallel(archive_name, files, num_files);
+    }
+
     // Abrir archivo
     FILE *archive = fopen(archive_name, "wb");
     if (!archive) {
         printf("Error al abrir el archivo %s\n", archive_name);
-        return;
+        return false;
     }
     if (verbose_level >= VERBOSE_SIMPLE) {
         printf("\tArchivo %s abierto con éxito.\n", archive_name);
     }
 
-    // Escribir el número inicial de espacios libres (0 al principio)
-    int num_free_spaces = 0;
-    fwrite(&num_free_spaces, sizeof(int), 1, archive);
+    // Escribir el identificador de formato, en el lugar del antiguo número de espacios libres
+    int format_marker = ARCHIVE_FORMAT_MARKER;
+    fwrite(&format_marker, sizeof(int), 1, archive);
 
 
     // Reservar espacio para la lista de espacios libres
@@ -189,6 +436,16 @@ void create(
     memset(&free_spaces, 0, sizeof(FreeSpaceInfo) * MAX_FREE_SPACES); // Llenar con ceros
     fwrite(&free_spaces, sizeof(FreeSpaceInfo), MAX_FREE_SPACES, archive);
 
+    // Reservar de una vez el tamaño final para que el contenido quede contiguo en disco
+    off_t total_size = HEADER_SIZE;
+    for (int i = 0; i < num_files; i++) {
+        struct stat file_stat;
+        if (stat(files[i], &file_stat) == 0) {
+            total_size += sizeof(FileInfo) + file_stat.st_size;
+        }
+    }
+    preallocate_range(fileno(archive), 0, total_size);
+
     // Escribir metadata
     ArchiveMetadata metadata = {num_files, 0};
     fwrite(&metadata, sizeof(ArchiveMetadata), 1, archive);
@@ -200,7 +457,8 @@ void create(
         FILE *file = fopen(files[i], "rb");
         if (!file) {
             printf("Error al abrir el archivo %s\n", files[i]);
-            return;
+            fclose(archive);
+            return false;
         }
         if (verbose_level >= VERBOSE_SIMPLE) {
             printf("\tArchivo %s abierto para lectura.\n", files[i]);
@@ -220,28 +478,36 @@ void create(
         }
         
 
-        // Escribir información de archivo
+        // Escribir información de archivo (sin bytes de relleno sin inicializar)
         FileInfo file_info;
+        memset(&file_info, 0, sizeof(FileInfo));
         strncpy(file_info.filename, files[i], 255);
         file_info.filename[255 - 1] = '\0';
         file_info.file_size = file_size;
         file_info.status = ACTIVE;
         file_info.start_position = ftell(archive) + sizeof(FileInfo);
+        struct stat file_stat;
+        fstat(fileno(file), &file_stat);
+        file_info.mode = file_stat.st_mode & 07777;
+        file_info.mtime = file_stat.st_mtime;
         fwrite(&file_info, sizeof(FileInfo), 1, archive);
         if (verbose_level >= VERBOSE_DETAILED) {
             printf("\tInformación del archivo %s escrita en el archivo de destino.\n", files[i]);
         }
 
-        // Escribir contenido del archivo
-        char *buffer = malloc(file_size);
-        fread(buffer, file_size, 1, file);
-        fwrite(buffer, file_size, 1, archive);
+        // Escribir contenido del archivo por bloques, cada uno sujeto a --limit-rate
+        fflush(archive);
+        if (!copy_range(fileno(file), 0, fileno(archive), file_info.start_position, file_size)) {
+            printf("Error al copiar el archivo %s\n", files[i]);
+            fclose(file);
+            fclose(archive);
+            return false;
+        }
+        fseek(archive, file_info.start_position + file_size, SEEK_SET);
         if (verbose_level >= VERBOSE_SIMPLE) {
             printf("\tContenido del archivo %s escrito en el archivo de destino.\n", files[i]);
         }
 
-        // Liberar memoria
-        free(buffer);
         fclose(file);
     }
     if (verbose_level >= VERBOSE_SIMPLE) {
@@ -249,19 +515,356 @@ void create(
     }
     // Cerrar archivo
     fclose(archive);
+    return true;
+}
+
+void *create_parallel_task(void *argument) {
+    CreateTask *task = argument;
+    while (true) {
+        // Tomar el próximo archivo pendiente
+        pthread_mutex_lock(&task->lock);
+        int i = task->next_index++;
+        pthread_mutex_unlock(&task->lock);
+        if (i >= task->num_files) {
+            break;
+        }
+
+        int file_fd = open(task->files[i], O_RDONLY);
+        bool copied = file_fd != -1
+            && copy_range(file_fd, 0, task->archive_fd, task->file_infos[i].start_position, task->file_infos[i].file_size);
+        if (file_fd != -1) {
+            close(file_fd);
+        }
+        if (!copied) {
+            printf("Error al copiar el archivo %s\n", task->files[i]);
+            pthread_mutex_lock(&task->lock);
+            task->failed = true;
+            pthread_mutex_unlock(&task->lock);
+        } else if (verbose_level >= VERBOSE_SIMPLE) {
+            printf("\tContenido del archivo %s escrito en el archivo de destino.\n", task->files[i]);
+        }
+    }
+    return NULL;
+}
+
+bool create_parallel(
+    const char *archive_name,  // Nombre del archivo de destino
+    char *files[],             // Arreglo de nombres de archivos para incluir en el archivo
+    int num_files              // Número de archivos en el arreglo
+) {
+    // Obtener el tamaño de todos los archivos y calcular la posición de cada uno
+    FileInfo *file_infos = malloc(sizeof(FileInfo) * (num_files > 0 ? num_files : 1));
+    off_t position = HEADER_SIZE;
+    for (int i = 0; i < num_files; i++) {
+        struct stat file_stat;
+        if (stat(files[i], &file_stat) != 0) {
+            printf("Error al abrir el archivo %s\n", files[i]);
+            free(file_infos);
+            return false;
+        }
+        memset(&file_infos[i], 0, sizeof(FileInfo));
+        strncpy(file_infos[i].filename, files[i], 255);
+        file_infos[i].filename[255 - 1] = '\0';
+        file_infos[i].file_size = file_stat.st_size;
+        file_infos[i].status = ACTIVE;
+        file_infos[i].mode = file_stat.st_mode & 07777;
+        file_infos[i].mtime = file_stat.st_mtime;
+        file_infos[i].start_position = position + sizeof(FileInfo);
+        position += sizeof(FileInfo) + file_stat.st_size;
+        if (verbose_level >= VERBOSE_DETAILED) {
+            printf("\tPosición de inicio del archivo %s en el archivo de destino: %ld.\n", files[i], (long)(file_infos[i].start_position - sizeof(FileInfo)));
+        }
+    }
+
+    // Abrir archivo con su tamaño final
+    int archive_fd = open(archive_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (archive_fd == -1) {
+        printf("Error al abrir el archivo %s\n", archive_name);
+        free(file_infos);
+        return false;
+    }
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tArchivo %s abierto con éxito.\n", archive_name);
+    }
+    preallocate_range(archive_fd, 0, position);
+    if (ftruncate(archive_fd, position) != 0) {
+        printf("Error al reservar %ld bytes para %s: %s\n", (long)position, archive_name, strerror(errno));
+        close(archive_fd);
+        free(file_infos);
+        return false;
+    }
+
+    // Copiar el contenido con escrituras posicionales desde varios hilos
+    CreateTask task;
+    task.archive_fd = archive_fd;
+    task.files = files;
+    task.file_infos = file_infos;
+    task.num_files = num_files;
+    task.next_index = 0;
+    task.failed = false;
+    pthread_mutex_init(&task.lock, NULL);
+    int num_workers = num_threads < num_files ? num_threads : num_files;
+    pthread_t *threads = malloc(sizeof(pthread_t) * (num_workers > 0 ? num_workers : 1));
+    int started = 0;
+    for (int t = 0; t < num_workers; t++) {
+        if (pthread_create(&threads[started], NULL, create_parallel_task, &task) == 0) {
+            started++;
+        }
+    }
+    if (started == 0) {
+        create_parallel_task(&task);
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&task.lock);
+
+    // Escribir la cabecera al final, cuando todo el contenido está en su lugar
+    bool written = !task.failed;
+    for (int i = 0; i < num_files && written; i++) {
+        written = pwrite(archive_fd, &file_infos[i], sizeof(FileInfo), file_infos[i].start_position - sizeof(FileInfo)) == sizeof(FileInfo);
+    }
+    if (written) {
+        int format_marker = ARCHIVE_FORMAT_MARKER;
+        FreeSpaceInfo free_spaces[MAX_FREE_SPACES];
+        memset(&free_spaces, 0, sizeof(FreeSpaceInfo) * MAX_FREE_SPACES);
+        ArchiveMetadata metadata = {num_files, 0};
+        written = pwrite(archive_fd, &format_marker, sizeof(int), 0) == sizeof(int)
+            && pwrite(archive_fd, &free_spaces, sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, sizeof(int)) == sizeof(FreeSpaceInfo) * MAX_FREE_SPACES
+            && pwrite(archive_fd, &metadata, sizeof(ArchiveMetadata), METADATA_POSITION) == sizeof(ArchiveMetadata);
+    }
+    if (!task.failed && !written) {
+        printf("Error al escribir la cabecera de %s: %s\n", archive_name, strerror(errno));
+    } else if (verbose_level >= VERBOSE_DETAILED) {
+        printf("\tMetadata escrito en el archivo.\n");
+    }
+
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tArchivo %s cerrado con éxito.\n", archive_name);
+    }
+    close(archive_fd);
+    free(file_infos);
+    return written;
+}
+
+void *create_volume_task(void *argument) {
+    VolumeTask *task = argument;
+    task->failed = !create(task->volume_name, task->files, task->num_files);
+    return NULL;
+}
+
+void create_volumes(
+    const char *archive_name,  // Nombre del manifiesto de volúmenes
+    char *files[],             // Arreglo de nombres de archivos para incluir en el archivo
+    int num_files              // Número de archivos en el arreglo
+) {
+    if (volume_size <= 0 && num_volumes > MAX_VOLUMES) {
+        printf("Error: se pueden crear como máximo %d volúmenes para %s\n", MAX_VOLUMES, archive_name);
+        return;
+    }
+    VolumeManifest manifest;
+    memset(&manifest, 0, sizeof(VolumeManifest));
+    manifest.metadata.num_files = num_files;
+
+    // Obtener el tamaño de todos los archivos antes de repartirlos
+    long *member_sizes = malloc(sizeof(long) * (num_files > 0 ? num_files : 1));
+    for (int i = 0; i < num_files; i++) {
+        struct stat file_stat;
+        if (stat(files[i], &file_stat) != 0) {
+            printf("Error al abrir el archivo %s\n", files[i]);
+            free(member_sizes);
+            return;
+        }
+        member_sizes[i] = sizeof(FileInfo) + file_stat.st_size;
+        manifest.metadata.total_size += file_stat.st_size;
+    }
+
+    // Repartir archivos: con --volume-size se llena cada volumen hasta el límite,
+    // si no se asigna cada archivo al volumen con menos bytes
+    int *assigned_volume = malloc(sizeof(int) * (num_files > 0 ? num_files : 1));
+    long volume_bytes[MAX_VOLUMES];
+    memset(volume_bytes, 0, sizeof(volume_bytes));
+    if (volume_size > 0) {
+        manifest.num_volumes = 1;
+        for (int i = 0; i < num_files; i++) {
+            int v = manifest.num_volumes - 1;
+            if (volume_bytes[v] > 0 && (long)HEADER_SIZE + volume_bytes[v] + member_sizes[i] > volume_size) {
+                if (manifest.num_volumes == MAX_VOLUMES) {
+                    printf("Error: se necesitan más de %d volúmenes para %s\n", MAX_VOLUMES, archive_name);
+                    free(assigned_volume);
+                    free(member_sizes);
+                    return;
+                }
+                v = manifest.num_volumes++;
+            }
+            assigned_volume[i] = v;
+            volume_bytes[v] += member_sizes[i];
+        }
+    } else {
+        manifest.num_volumes = num_volumes;
+        for (int i = 0; i < num_files; i++) {
+            int v = 0;
+            for (int k = 1; k < manifest.num_volumes; k++) {
+                if (volume_bytes[k] < volume_bytes[v]) v = k;
+            }
+            assigned_volume[i] = v;
+            volume_bytes[v] += member_sizes[i];
+        }
+    }
+
+    // Nombres de los volúmenes, repartidos entre los directorios de --volume-dirs.
+    // Se guardan relativos al directorio del manifiesto para poder leerlos desde cualquier lugar
+    char *dirs[MAX_VOLUMES];
+    int num_dirs = 0;
+    char *dirs_copy = volume_dirs ? strdup(volume_dirs) : NULL;
+    for (char *dir = dirs_copy ? strtok(dirs_copy, ":") : NULL; dir && num_dirs < MAX_VOLUMES; dir = strtok(NULL, ":")) {
+        dirs[num_dirs++] = dir;
+    }
+    const char *base_name = strrchr(archive_name, '/') ? strrchr(archive_name, '/') + 1 : archive_name;
+    char resolved_names[MAX_VOLUMES][255];
+    for (int v = 0; v < manifest.num_volumes; v++) {
+        if (num_dirs > 0) {
+            snprintf(manifest.volume_names[v], 255, "%s/%s.%d", dirs[v % num_dirs], base_name, v + 1);
+        } else {
+            snprintf(manifest.volume_names[v], 255, "%s.%d", base_name, v + 1);
+        }
+        resolve_volume_name(archive_name, manifest.volume_names[v], resolved_names[v]);
+    }
+    free(dirs_copy);
+
+    // Escribir cada volumen en su propio hilo
+    VolumeTask tasks[MAX_VOLUMES];
+    memset(tasks, 0, sizeof(tasks));
+    for (int v = 0; v < manifest.num_volumes; v++) {
+        tasks[v].volume_name = resolved_names[v];
+        tasks[v].files = malloc(sizeof(char *) * (num_files > 0 ? num_files : 1));
+        for (int i = 0; i < num_files; i++) {
+            if (assigned_volume[i] == v) {
+                tasks[v].files[tasks[v].num_files++] = files[i];
+            }
+        }
+        if (verbose_level >= VERBOSE_DETAILED) {
+            printf("\tVolumen %s: %d archivos, %ld bytes.\n", tasks[v].volume_name, tasks[v].num_files, volume_bytes[v]);
+        }
+    }
+    run_volume_tasks(tasks, manifest.num_volumes, create_volume_task);
+
+    // Sin todos los volúmenes el manifiesto apuntaría a archivos que no existen
+    int failed_volumes = 0;
+    for (int v = 0; v < manifest.num_volumes; v++) {
+        if (tasks[v].failed) {
+            printf("Error al crear el volumen %s\n", tasks[v].volume_name);
+            failed_volumes++;
+        }
+    }
+
+    // Escribir el manifiesto con la misma cabecera que un archivo normal
+    FILE *archive = failed_volumes > 0 ? NULL : fopen(archive_name, "wb");
+    if (failed_volumes > 0) {
+        printf("No se escribió el manifiesto %s porque falló la creación de %d volúmenes.\n", archive_name, failed_volumes);
+    } else if (!archive) {
+        printf("Error al abrir el archivo %s\n", archive_name);
+    } else {
+        int marker = VOLUME_MANIFEST_MARKER;
+        fwrite(&marker, sizeof(int), 1, archive);
+        FreeSpaceInfo free_spaces[MAX_FREE_SPACES];
+        memset(&free_spaces, 0, sizeof(FreeSpaceInfo) * MAX_FREE_SPACES);
+        fwrite(&free_spaces, sizeof(FreeSpaceInfo), MAX_FREE_SPACES, archive);
+        fwrite(&manifest, sizeof(VolumeManifest), 1, archive);
+        fclose(archive);
+        if (verbose_level >= VERBOSE_SIMPLE) {
+            printf("\tManifiesto %s escrito con %d volúmenes.\n", archive_name, manifest.num_volumes);
+        }
+    }
+
+    for (int v = 0; v < manifest.num_volumes; v++) {
+        free(tasks[v].files);
+    }
+    free(assigned_volume);
+    free(member_sizes);
+}
+
+
+
+void *list_volume_task(void *argument) {
+    // Leer todas las cabeceras de un volumen; la impresión se hace en orden desde el hilo principal
+    VolumeTask *task = argument;
+    FILE *volume = fopen(task->volume_name, "rb");
+    if (!volume) {
+        task->num_file_infos = -1;
+        return NULL;
+    }
+    if (!check_archive_format(fileno(volume), task->volume_name, NULL)) {
+        fclose(volume);
+        task->num_file_infos = -1;
+        return NULL;
+    }
+    task->num_file_infos = load_file_infos(volume, &task->file_infos, false);
+    fclose(volume);
+    return NULL;
 }
 
+void list_volumes(
+    const VolumeManifest *manifest // Manifiesto de volúmenes
+) {
+    VolumeTask tasks[MAX_VOLUMES];
+    memset(tasks, 0, sizeof(tasks));
+    for (int v = 0; v < manifest->num_volumes; v++) {
+        tasks[v].volume_name = manifest->volume_names[v];
+    }
+    // Leer los volúmenes en paralelo
+    run_volume_tasks(tasks, manifest->num_volumes, list_volume_task);
 
+    int active_files_count = 0;
+    for (int v = 0; v < manifest->num_volumes; v++) {
+        if (tasks[v].num_file_infos < 0) {
+            printf("Error al abrir el archivo %s\n", tasks[v].volume_name);
+            continue;
+        }
+        if (verbose_level >= VERBOSE_SIMPLE) {
+            printf("\tVolumen %d: %s\n", v + 1, tasks[v].volume_name);
+        }
+        for (int i = 0; i < tasks[v].num_file_infos; i++) {
+            FileInfo *file_info = &tasks[v].file_infos[i];
+            if (file_info->status == ACTIVE) {
+                active_files_count++;
+                printf("\tArchivo: %s\n", file_info->filename);
+                if (verbose_level == VERBOSE_DETAILED) {
+                    printf("\tTamaño del archivo: %lu bytes\n", file_info->file_size + sizeof(FileInfo));
+                    printf("\tPosición de inicio en el archivo comprimido: %lu\n", file_info->start_position - sizeof(FileInfo));
+                }
+            }
+        }
+        free(tasks[v].file_infos);
+    }
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tNúmero de archivos activos en el archivo comprimido: %d\n", active_files_count);
+        printf("\tOperación de listar completada exitosamente.\n");
+    }
+}
 
 void list(
     const char *archive_name // Nombre del archivo tar
 ) {
+    // Un manifiesto de volúmenes se lista leyendo cada volumen
+    VolumeManifest manifest;
+    if (load_volume_manifest(archive_name, &manifest)) {
+        list_volumes(&manifest);
+        return;
+    }
+
     // Abrir archivo
     FILE *archive = fopen(archive_name, "rb");
     if (!archive) {
         printf("Error al abrir el archivo %s\n", archive_name);
         return;
     }
+    bool legacy;
+    if (!check_archive_format(fileno(archive), archive_name, &legacy)) {
+        fclose(archive);
+        return;
+    }
     
     // Saltar el número inicial de espacios libres
     fseek(archive, sizeof(int), SEEK_CUR);
@@ -282,10 +885,10 @@ void list(
     // Listar archivos
     for (int i = 0; i < metadata.num_files; i++) {
         FileInfo file_info;
-        size_t read = fread(&file_info, sizeof(FileInfo), 1, archive);
+        bool read = read_file_info(archive, &file_info, legacy);
 
         // Si no se pudo leer más data, salir del loop
-        if (read < 1) {
+        if (!read) {
             break;
         }
 
@@ -316,15 +919,51 @@ void list(
 void extractAll(
     const char *archive_name // Nombre del archivo tar
 ) {
+    extract(archive_name, NULL, 0);
+}
+
+void *extract_volume_task(void *argument) {
+    VolumeTask *task = argument;
+    extract(task->volume_name, task->files, task->num_files);
+    return NULL;
+}
+
+void extract(
+    const char *archive_name, // Nombre del archivo tar
+    char *files[], // Archivos a extraer
+    int num_files // Número de archivos a extraer, 0 para extraer todos
+) {
+    // Un manifiesto de volúmenes se extrae leyendo todos los volúmenes en paralelo
+    VolumeManifest manifest;
+    if (load_volume_manifest(archive_name, &manifest)) {
+        VolumeTask tasks[MAX_VOLUMES];
+        memset(tasks, 0, sizeof(tasks));
+        for (int v = 0; v < manifest.num_volumes; v++) {
+            tasks[v].volume_name = manifest.volume_names[v];
+            tasks[v].files = files;
+            tasks[v].num_files = num_files;
+        }
+        run_volume_tasks(tasks, manifest.num_volumes, extract_volume_task);
+        return;
+    }
+
     // Abrir el archivo tar
     FILE *archive = fopen(archive_name, "rb");
     if (!archive) {
         printf("Error al abrir el archivo %s\n", archive_name);
         return;
     }
+    bool legacy;
+    if (!check_archive_format(fileno(archive), archive_name, &legacy)) {
+        fclose(archive);
+        return;
+    }
     if (verbose_level >= VERBOSE_SIMPLE) {
         printf("\tArchivo %s abierto con éxito.\n", archive_name);
     }
+    // Directorios de destino ya abiertos, para no resolver la ruta completa en cada archivo
+    DirectoryCache *directory_cache = malloc(sizeof(DirectoryCache));
+    init_directory_cache(directory_cache);
 
     // Saltar el número inicial de espacios libres
     fseek(archive, sizeof(int), SEEK_CUR);
@@ -341,40 +980,66 @@ void extractAll(
     // Recorrer y extraer todos los archivos
     for (int i = 0; i < metadata.num_files; i++) {
         FileInfo file_info;
-        fread(&file_info, sizeof(FileInfo), 1, archive);
+        if (!read_file_info(archive, &file_info, legacy)) {
+            break;
+        }
 
         if (verbose_level >= VERBOSE_DETAILED) {
             printf("\tLeyendo información del archivo %d de %d.\n", i+1, metadata.num_files);
         }
 
+        // Verificar si el archivo fue solicitado
+        bool requested = num_files == 0;
+        for (int j = 0; j < num_files && !requested; j++) {
+            requested = strcmp(files[j], file_info.filename) == 0;
+        }
+
         // Verificar si el archivo está activo
-        if (file_info.status == ACTIVE) {
-            FILE *output = fopen(file_info.filename, "wb");
+        if (file_info.status == ACTIVE && requested) {
+            int output_fd = open_extract_target(directory_cache, file_info.filename);
+            FILE *output = output_fd != -1 ? fdopen(output_fd, "wb") : NULL;
             if (!output) {
                 printf("Error al abrir el archivo %s\n", file_info.filename);
+                if (output_fd != -1) close(output_fd);
+                fseek(archive, file_info.file_size, SEEK_CUR);
             } else {
                 if (verbose_level >= VERBOSE_SIMPLE) {
                     printf("\tArchivo %s abierto para escritura.\n", file_info.filename);
                 }
 
                 // Leer y escribir el contenido del archivo
-                char buffer[1024];
+                char *buffer = malloc(COPY_BUFFER_SIZE);
                 int bytes_left = file_info.file_size;
 
                 while (bytes_left > 0) {
-                    int bytes_to_read = bytes_left < sizeof(buffer) ? bytes_left : sizeof(buffer);
+                    int bytes_to_read = bytes_left < COPY_BUFFER_SIZE ? bytes_left : COPY_BUFFER_SIZE;
+                    throttle_io(bytes_to_read);
                     fread(buffer, bytes_to_read, 1, archive);
                     fwrite(buffer, bytes_to_read, 1, output);
                     bytes_left -= bytes_to_read;
                 }
-
+                free(buffer);
+
+                // Restaurar permisos y fecha de modificación
+                fflush(output);
+                drop_cached_range(fileno(archive), file_info.start_position, file_info.file_size);
+                drop_cached_range(output_fd, 0, file_info.file_size);
+                // Los bits setuid, setgid y sticky de una cabecera ajena solo se aplican si se piden
+                if (file_info.mode != 0) {
+                    fchmod(output_fd, file_info.mode & (preserve_permissions ? 07777 : 0777));
+                }
+                // El formato anterior no guarda permisos ni fecha
+                if (!legacy) {
+                    struct timespec times[2] = {{0, UTIME_NOW}, {file_info.mtime, 0}};
+                    futimens(output_fd, times);
+                }
                 fclose(output);
                 if (verbose_level >= VERBOSE_SIMPLE) {
                     printf("\tArchivo extraído: %s\n", file_info.filename);
                 }
             }
         } else {
-            // Si el archivo no está activo, aún debes saltar su contenido para procesar el siguiente archivo
+            // Si el archivo no está activo o no fue solicitado, aún debes saltar su contenido para procesar el siguiente archivo
             fseek(archive, file_info.file_size, SEEK_CUR);
         }
     }
@@ -383,6 +1048,8 @@ void extractAll(
     }
 
     // Cerrar el archivo tar
+    close_directory_cache(directory_cache);
+    free(directory_cache);
     fclose(archive);
 }
 
@@ -390,18 +1057,30 @@ void delete(
     const char *archive_name, // Nombre del archivo tar
     const char *file_to_delete // Nombre del archivo a eliminar
 ) {
+    if (reject_volume_manifest(archive_name)) {
+        return;
+    }
     FILE *archive = fopen(archive_name, "rb+");
     if (!archive) {
         printf("Error al abrir el archivo %s\n", archive_name);
         return;
     }
+    if (!check_archive_format(fileno(archive), archive_name, NULL)) {
+        fclose(archive);
+        return;
+    }
+    // Bloquear la cabecera para no interferir con escritores concurrentes
+    if (!lock_archive_header(fileno(archive), F_WRLCK)) {
+        fclose(archive);
+        return;
+    }
     if (verbose_level >= VERBOSE_SIMPLE) {
         printf("\tArchivo %s abierto con éxito.\n", archive_name);
     }
 
     // Buscar el archivo
     FileInfo file_info;
-    if(!find_file_info(archive, file_to_delete, &file_info)) {
+    if(!find_file_info(archive, file_to_delete, &file_info, false)) {
         printf("El archivo %s no fue encontrado en el archivo.\n", file_to_delete);
         fclose(archive);
         return;
@@ -428,6 +1107,8 @@ void delete(
     if (verbose_level >= VERBOSE_SIMPLE) {
         printf("\tArchivo %s marcado como eliminado.\n", file_to_delete);
     }
+    // Devolver los bloques del contenido al sistema de archivos; la cabecera se conserva para el recorrido
+    punch_hole(fileno(archive), file_info.start_position, file_info.file_size);
 
     // Marcar el espacio ocupado por el archivo como espacio libre
     FreeSpaceInfo new_free_space;
@@ -455,7 +1136,8 @@ void delete(
 bool find_file_info (
     FILE *archive, // Archivo tar
     const char *file_name, // Nombre del archivo a buscar
-    FileInfo *file_info // Puntero a estructura donde se guardará la información del archivo
+    FileInfo *file_info, // Puntero a estructura donde se guardará la información del archivo
+    bool legacy // Cabeceras del formato anterior
 ) {
     // Saltar el número inicial de espacios libres
     fseek(archive, sizeof(int), SEEK_CUR);
@@ -465,29 +1147,35 @@ bool find_file_info (
 
     // Leer metadatos del archivo
     ArchiveMetadata metadata;
+    // Con --cat la salida estándar lleva solo datos
+    FILE *messages = raw_output ? stderr : stdout;
     if (fread(&metadata, sizeof(ArchiveMetadata), 1, archive) != 1) {
-        printf("Error al leer metadatos.\n");
+        fprintf(messages, "Error al leer metadatos.\n");
         return false;
     }
 
     // Buscar el archivo en la lista de archivos
     for (int i = 0; i < metadata.num_files; i++) {
         // Leer información de archivo
-        if (fread(file_info, sizeof(FileInfo), 1, archive) != 1) {
-            printf("Error al leer FileInfo en la iteración %d.\n", i);
+        if (!read_file_info(archive, file_info, legacy)) {
+            fprintf(messages, "Error al leer FileInfo en la iteración %d.\n", i);
             return false;
         }
 
         // Mensaje de diagnóstico
-        printf("Buscando: %s, Encontrado: %s\n", file_name, file_info->filename);
+        if (verbose_level >= VERBOSE_DETAILED) {
+            fprintf(messages, "Buscando: %s, Encontrado: %s\n", file_name, file_info->filename);
+        }
 
-        // Comparar nombre de archivo
-        if (strcmp(file_info->filename, file_name) == 0) {
-            if (file_info->status == DELETED) {
-                printf("El archivo %s fue encontrado pero está marcado como DELETED.\n", file_name);
-                return false;
+        // Comparar nombre de archivo (las regiones reservadas aún no están publicadas)
+        if (file_info->status != RESERVED && strcmp(file_info->filename, file_name) == 0) {
+            if (file_info->status == ACTIVE) {
+                return true;
+            }
+            // Una versión anterior borrada o actualizada; la activa puede estar más adelante
+            if (verbose_level >= VERBOSE_DETAILED) {
+                fprintf(messages, "El archivo %s fue encontrado pero está marcado como DELETED.\n", file_name);
             }
-            return true;
         }
 
         // Saltar contenido de archivo para buscar el próximo FileInfo
@@ -533,47 +1221,640 @@ void insert_and_combine_free_space(FreeSpaceInfo free_spaces[MAX_FREE_SPACES], F
         }
     }
 }
-void print_free_spaces(const char *archive_name) {
-    FILE *archive = fopen(archive_name, "rb");
-    if (!archive) {
-        printf("Error al abrir el archivo %s\n", archive_name);
-        return;
+void init_directory_cache(DirectoryCache *cache) {
+    for (int i = 0; i < DIRECTORY_CACHE_SIZE; i++) {
+        cache->paths[i][0] = '\0';
+        cache->fds[i] = -1;
     }
-    if (verbose_level >= VERBOSE_SIMPLE) {
-        printf("\tArchivo %s abierto con éxito para mostrar espacios libres.\n", archive_name);
+}
+
+void close_directory_cache(DirectoryCache *cache) {
+    for (int i = 0; i < DIRECTORY_CACHE_SIZE; i++) {
+        if (cache->fds[i] != -1) {
+            close(cache->fds[i]);
+            cache->fds[i] = -1;
+        }
     }
-    // Cargar espacios libres
-    FreeSpaceInfo free_spaces[MAX_FREE_SPACES];
-    load_free_spaces(archive, free_spaces);
-    if (verbose_level >= VERBOSE_DETAILED) {
-        printf("\tEspacios libres cargados del archivo.\n");
+}
+
+int open_directory(
+    DirectoryCache *cache, // Directorios ya abiertos
+    const char *path // Ruta del directorio, relativa al directorio actual ("" es el directorio actual)
+) {
+    if (path[0] == '\0') {
+        return AT_FDCWD;
     }
-    // Mostrar espacios libres
-    printf("Espacios Libres en %s:\n", archive_name);
-    for (int i = 0; i < MAX_FREE_SPACES; i++) {
-        if (free_spaces[i].size > 0) {
-            printf("\tEspacio %d: Inicio en posición %d, Tamaño: %d bytes.\n", 
-                   i, free_spaces[i].start_position, free_spaces[i].size);
+    // Buscar en la caché (una entrada por posición de la tabla)
+    unsigned int hash = 2166136261u;
+    for (const char *c = path; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    int slot = hash % DIRECTORY_CACHE_SIZE;
+    if (cache->fds[slot] != -1 && strcmp(cache->paths[slot], path) == 0) {
+        return cache->fds[slot];
+    }
+
+    // Abrir el directorio relativo a su padre, creándolo solo si no existe
+    char parent[255];
+    snprintf(parent, sizeof(parent), "%s", path);
+    char *last_slash = strrchr(parent, '/');
+    const char *name = path;
+    if (last_slash) {
+        *last_slash = '\0';
+        name = path + (last_slash - parent) + 1;
+    } else {
+        parent[0] = '\0';
+    }
+    int parent_fd = open_directory(cache, parent);
+    if (parent_fd == -1) {
+        return -1;
+    }
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY);
+    if (fd == -1 && errno == ENOENT) {
+        if (mkdirat(parent_fd, name, 0755) == 0 || errno == EEXIST) {
+            fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY);
+        }
+        if (fd != -1 && verbose_level >= VERBOSE_DETAILED) {
+            printf("\tDirectorio %s creado.\n", path);
         }
     }
+    if (fd == -1) {
+        printf("Error al crear el directorio %s\n", path);
+        return -1;
+    }
 
-    fclose(archive);
-    if (verbose_level >= VERBOSE_SIMPLE) {
-        printf("\tArchivo %s cerrado con éxito después de mostrar espacios libres.\n", archive_name);
+    // Guardar en la caché, cerrando el directorio que ocupaba la posición
+    if (cache->fds[slot] != -1) {
+        close(cache->fds[slot]);
     }
+    snprintf(cache->paths[slot], 255, "%s", path);
+    cache->fds[slot] = fd;
+    return fd;
 }
 
-void append(
-    const char *archive_name, // Nombre del archivo de destino
-    const char *file_to_add // Nombre del archivo a añadir
+int open_extract_target(
+    DirectoryCache *cache, // Directorios ya abiertos
+    const char *filename // Nombre del archivo dentro del archivo tar
 ) {
-    FILE *archive = fopen(archive_name, "rb+");
-    if (!archive) {
-        printf("Error al abrir el archivo %s\n", archive_name);
-        return;
+    // Las rutas absolutas se extraen relativas al directorio actual y no se permite salir con ".."
+    while (filename[0] == '/') {
+        filename++;
     }
-    if (verbose_level >= VERBOSE_SIMPLE) {
-        printf("\tArchivo %s abierto con éxito para añadir.\n", archive_name);
+    char path[255];
+    snprintf(path, sizeof(path), "%s", filename);
+    for (char *component = path; component; component = strchr(component, '/') ? strchr(component, '/') + 1 : NULL) {
+        if (strncmp(component, "..", 2) == 0 && (component[2] == '/' || component[2] == '\0')) {
+            printf("Ruta no permitida: %s\n", filename);
+            return -1;
+        }
+    }
+
+    char *last_slash = strrchr(path, '/');
+    const char *name = path;
+    int directory_fd = AT_FDCWD;
+    if (last_slash) {
+        *last_slash = '\0';
+        name = last_slash + 1;
+        directory_fd = open_directory(cache, path);
+        if (directory_fd == -1) {
+            return -1;
+        }
+    }
+    return openat(directory_fd, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+int take_free_space(
+    FILE *archive, // Archivo tar
+    FreeSpaceInfo free_spaces[MAX_FREE_SPACES], // Lista de espacios libres cargada
+    int needed_size, // Bytes necesarios: FileInfo y contenido
+    int *entries_delta // Cambio en el número de cabeceras que recorre list
+) {
+    // First Fit: el espacio debe calzar exacto o dejar lugar para una cabecera de relleno,
+    // para que el recorrido secuencial de cabeceras siga siendo válido
+    int index_found = -1;
+    for (int i = 0; i < MAX_FREE_SPACES; i++) {
+        if (free_spaces[i].size == needed_size || free_spaces[i].size >= needed_size + (int)sizeof(FileInfo)) {
+            index_found = i;
+            break;
+        }
+    }
+    if (index_found == -1) {
+        *entries_delta = 1;
+        return -1;
+    }
+    int start_position = free_spaces[index_found].start_position;
+    int end_position = start_position + free_spaces[index_found].size;
+
+    // Contar las cabeceras borradas que cubre el espacio (pueden ser varias si se combinaron)
+    int covered_entries = 0;
+    for (int position = start_position; position < end_position; covered_entries++) {
+        FileInfo covered;
+        fseek(archive, position, SEEK_SET);
+        if (fread(&covered, sizeof(FileInfo), 1, archive) != 1) {
+            break;
+        }
+        position += sizeof(FileInfo) + covered.file_size;
+    }
+
+    free_spaces[index_found].start_position += needed_size;
+    free_spaces[index_found].size -= needed_size;
+    *entries_delta = 1 - covered_entries;
+    if (free_spaces[index_found].size == 0) {
+        memset(&free_spaces[index_found], 0, sizeof(FreeSpaceInfo));
+    } else {
+        // Cabecera de relleno que cubre el resto del espacio libre
+        FileInfo filler;
+        memset(&filler, 0, sizeof(FileInfo));
+        filler.file_size = free_spaces[index_found].size - sizeof(FileInfo);
+        filler.start_position = free_spaces[index_found].start_position + sizeof(FileInfo);
+        filler.status = DELETED;
+        fseek(archive, free_spaces[index_found].start_position, SEEK_SET);
+        fwrite(&filler, sizeof(FileInfo), 1, archive);
+        (*entries_delta)++;
+    }
+    return start_position;
+}
+
+void print_free_spaces(const char *archive_name) {
+    FILE *archive = fopen(archive_name, "rb");
+    if (!archive) {
+        printf("Error al abrir el archivo %s\n", archive_name);
+        return;
+    }
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tArchivo %s abierto con éxito para mostrar espacios libres.\n", archive_name);
+    }
+    // Cargar espacios libres
+    FreeSpaceInfo free_spaces[MAX_FREE_SPACES];
+    load_free_spaces(archive, free_spaces);
+    if (verbose_level >= VERBOSE_DETAILED) {
+        printf("\tEspacios libres cargados del archivo.\n");
+    }
+    // Mostrar espacios libres
+    printf("Espacios Libres en %s:\n", archive_name);
+    for (int i = 0; i < MAX_FREE_SPACES; i++) {
+        if (free_spaces[i].size > 0) {
+            printf("\tEspacio %d: Inicio en posición %d, Tamaño: %d bytes.\n", 
+                   i, free_spaces[i].start_position, free_spaces[i].size);
+        }
+    }
+
+    fclose(archive);
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tArchivo %s cerrado con éxito después de mostrar espacios libres.\n", archive_name);
+    }
+}
+
+bool lock_archive_header(
+    int archive_fd, // Descriptor del archivo tar
+    short lock_type // F_WRLCK para bloquear, F_UNLCK para liberar
+) {
+    // El bloqueo cubre solo la cabecera: espacios libres y metadata
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = lock_type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = 0;
+    lock.l_len = HEADER_SIZE;
+    while (fcntl(archive_fd, F_SETLKW, &lock) == -1) {
+        if (errno != EINTR) {
+            printf("Error al bloquear la cabecera del archivo: %s\n", strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool lock_reserved_region(
+    int archive_fd, // Descriptor del archivo tar
+    const FileInfo *file_info // Cabecera RESERVED recién escrita
+) {
+    // El escritor conserva este bloqueo mientras copia; se libera solo al cerrar el descriptor o al terminar el proceso
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = file_info->start_position - sizeof(FileInfo);
+    lock.l_len = sizeof(FileInfo) + file_info->file_size;
+    return fcntl(archive_fd, F_SETLK, &lock) == 0;
+}
+
+bool reservation_in_use(
+    int archive_fd, // Descriptor del archivo tar
+    const FileInfo *file_info // Cabecera RESERVED encontrada en el recorrido
+) {
+    // Una reserva sin bloqueo quedó abandonada por un escritor que falló o terminó
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = file_info->start_position - sizeof(FileInfo);
+    lock.l_len = sizeof(FileInfo) + file_info->file_size;
+    if (fcntl(archive_fd, F_GETLK, &lock) == -1) {
+        return true;
+    }
+    return lock.l_type != F_UNLCK;
+}
+
+bool copy_range(
+    int in_fd, // Descriptor de origen
+    off_t in_offset, // Posición de lectura en el origen
+    int out_fd, // Descriptor de destino
+    off_t out_offset, // Posición de escritura en el destino, -1 para escribir en orden (tuberías)
+    off_t length // Cantidad de bytes a copiar
+) {
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    if (!buffer) {
+        return false;
+    }
+    // Copiar con lecturas y escrituras posicionales, sin mover el cursor de los descriptores
+    while (length > 0) {
+        size_t chunk = length < COPY_BUFFER_SIZE ? length : COPY_BUFFER_SIZE;
+        throttle_io(chunk);
+        ssize_t bytes_read = pread(in_fd, buffer, chunk, in_offset);
+        if (bytes_read <= 0) {
+            if (bytes_read == -1 && errno == EINTR) continue;
+            free(buffer);
+            return false;
+        }
+        ssize_t bytes_written = 0;
+        while (bytes_written < bytes_read) {
+            ssize_t result = out_offset < 0
+                ? write(out_fd, buffer + bytes_written, bytes_read - bytes_written)
+                : pwrite(out_fd, buffer + bytes_written, bytes_read - bytes_written, out_offset + bytes_written);
+            if (result == -1) {
+                if (errno == EINTR) continue;
+                free(buffer);
+                return false;
+            }
+            bytes_written += result;
+        }
+        drop_cached_range(in_fd, in_offset, bytes_read);
+        if (out_offset >= 0) drop_cached_range(out_fd, out_offset, bytes_read);
+        in_offset += bytes_read;
+        if (out_offset >= 0) out_offset += bytes_read;
+        length -= bytes_read;
+    }
+    free(buffer);
+    return true;
+}
+
+bool write_member(
+    FILE *archive, // Archivo tar, posicionado donde va la cabecera
+    int file_fd, // Descriptor del archivo a copiar
+    FileInfo *file_info, // Cabecera con la posición y el tamaño ya calculados
+    FreeSpaceInfo free_spaces[MAX_FREE_SPACES] // Lista de espacios libres cargada
+) {
+    // Copiar el contenido por bloques (cada uno sujeto a --limit-rate) y escribir la cabecera después.
+    // Si la copia falla, la región queda registrada como archivo borrado y espacio libre
+    off_t header_position = ftell(archive);
+    fflush(archive);
+    bool copied = copy_range(file_fd, 0, fileno(archive), file_info->start_position, file_info->file_size);
+    if (!copied) {
+        printf("Error al copiar el archivo %s; su espacio queda libre.\n", file_info->filename);
+        file_info->status = DELETED;
+        FreeSpaceInfo failed_space;
+        failed_space.start_position = header_position;
+        failed_space.size = file_info->file_size + sizeof(FileInfo);
+        insert_and_combine_free_space(free_spaces, failed_space);
+        struct stat archive_stat;
+        if (fstat(fileno(archive), &archive_stat) == 0 && archive_stat.st_size < file_info->start_position + file_info->file_size) {
+            ftruncate(fileno(archive), file_info->start_position + file_info->file_size);
+        }
+    }
+    fseek(archive, header_position, SEEK_SET);
+    fwrite(file_info, sizeof(FileInfo), 1, archive);
+    return copied;
+}
+
+bool copy_range_kernel(
+    int in_fd, // Descriptor de origen
+    off_t in_offset, // Posición de lectura en el origen
+    int out_fd, // Descriptor de destino
+    off_t out_offset, // Posición de escritura en el destino
+    off_t length // Cantidad de bytes a copiar
+) {
+    // Copiar dentro del kernel sin pasar por memoria del proceso; con límites de E/S se copia por bloques
+    bool limited = rate_limit_bytes > 0 || rate_limit_iops > 0 || drop_cache;
+    while (length > 0) {
+        size_t chunk = limited && length > COPY_BUFFER_SIZE ? COPY_BUFFER_SIZE : length;
+        throttle_io(chunk);
+        off_t chunk_in_offset = in_offset;
+        off_t chunk_out_offset = out_offset;
+        ssize_t copied = copy_file_range(in_fd, &in_offset, out_fd, &out_offset, chunk, 0);
+        if (copied == -1 && errno == EINTR) {
+            continue;
+        }
+        if (copied <= 0) {
+            // Sistemas de archivos distintos o sin soporte: copiar el resto con lectura y escritura
+            return copy_range(in_fd, in_offset, out_fd, out_offset, length);
+        }
+        drop_cached_range(in_fd, chunk_in_offset, copied);
+        drop_cached_range(out_fd, chunk_out_offset, copied);
+        length -= copied;
+    }
+    return true;
+}
+
+void throttle_io(
+    long bytes // Bytes de la operación que está por hacerse
+) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double wait = 0;
+
+    pthread_mutex_lock(&io_throttle.lock);
+    if (!io_throttle.started) {
+        io_throttle.started = true;
+        io_throttle.start = now;
+        io_throttle.last_refill = now;
+        io_throttle.byte_tokens = 0;
+        io_throttle.op_tokens = 0;
+    }
+    io_throttle.total_bytes += bytes;
+    io_throttle.total_ops++;
+
+    // Rellenar los baldes según el tiempo transcurrido (empiezan vacíos, capacidad: un segundo de tasa) y cobrar la operación.
+    // Si queda deuda, el hilo duerme lo que tarda en pagarse
+    double elapsed = (now.tv_sec - io_throttle.last_refill.tv_sec) + (now.tv_nsec - io_throttle.last_refill.tv_nsec) / 1e9;
+    io_throttle.last_refill = now;
+    if (rate_limit_bytes > 0) {
+        io_throttle.byte_tokens += elapsed * rate_limit_bytes;
+        if (io_throttle.byte_tokens > rate_limit_bytes) io_throttle.byte_tokens = rate_limit_bytes;
+        io_throttle.byte_tokens -= bytes;
+        if (io_throttle.byte_tokens < 0) wait = -io_throttle.byte_tokens / rate_limit_bytes;
+    }
+    if (rate_limit_iops > 0) {
+        io_throttle.op_tokens += elapsed * rate_limit_iops;
+        if (io_throttle.op_tokens > rate_limit_iops) io_throttle.op_tokens = rate_limit_iops;
+        io_throttle.op_tokens -= 1;
+        if (io_throttle.op_tokens < 0 && -io_throttle.op_tokens / rate_limit_iops > wait) wait = -io_throttle.op_tokens / rate_limit_iops;
+    }
+    pthread_mutex_unlock(&io_throttle.lock);
+
+    if (wait > 0) {
+        struct timespec delay = {(time_t)wait, (long)((wait - (time_t)wait) * 1e9)};
+        while (nanosleep(&delay, &delay) == -1 && errno == EINTR);
+    }
+}
+
+void drop_cached_range(
+    int fd, // Descriptor del archivo
+    off_t offset, // Inicio de la región ya copiada
+    off_t length // Tamaño de la región
+) {
+    // Con --drop-cache las copias masivas no desplazan del caché las páginas de otros servicios.
+    // Las páginas escritas se envían al disco primero, porque DONTNEED solo descarta páginas limpias
+    if (!drop_cache || length <= 0) {
+        return;
+    }
+    sync_file_range(fd, offset, length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+}
+
+bool apply_io_priority(
+    const char *priority // "idle", "best-effort[:0-7]" o "realtime[:0-7]"
+) {
+    // Clases de ioprio_set(2): 1 tiempo real, 2 mejor esfuerzo, 3 inactiva
+    int io_class;
+    int level = 4;
+    const char *colon = strchr(priority, ':');
+    if (strncmp(priority, "idle", 4) == 0) {
+        io_class = 3;
+        level = 0;
+    } else if (strncmp(priority, "best-effort", 11) == 0) {
+        io_class = 2;
+    } else if (strncmp(priority, "realtime", 8) == 0) {
+        io_class = 1;
+    } else {
+        printf("Prioridad de E/S no válida: %s\n", priority);
+        return false;
+    }
+    if (colon && io_class != 3) {
+        level = atoi(colon + 1);
+    }
+    if (syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, (io_class << 13) | level) == -1) {
+        printf("No se pudo cambiar la prioridad de E/S: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void report_io_throughput(
+    FILE *stream // Donde se escribe el reporte
+) {
+    if (!io_throttle.started) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - io_throttle.start.tv_sec) + (now.tv_nsec - io_throttle.start.tv_nsec) / 1e9;
+    if (elapsed <= 0) {
+        elapsed = 1e-9;
+    }
+    fprintf(stream, "Rendimiento de E/S: %ld bytes en %ld operaciones, %.2f s, %.2f MB/s, %.0f operaciones/s.\n",
+            io_throttle.total_bytes, io_throttle.total_ops, elapsed,
+            io_throttle.total_bytes / elapsed / (1024 * 1024), io_throttle.total_ops / elapsed);
+}
+
+void preallocate_range(
+    int archive_fd, // Descriptor del archivo tar
+    off_t offset, // Inicio de la región
+    off_t length // Tamaño de la región
+) {
+    // Reservar los bloques de una vez; si el sistema de archivos no lo soporta, las escrituras los asignan.
+    // El tamaño no cambia: solo las escrituras completadas extienden el archivo
+    if (length > 0 && fallocate(archive_fd, FALLOC_FL_KEEP_SIZE, offset, length) == -1 && verbose_level >= VERBOSE_DETAILED) {
+        printf("\tNo se pudo preasignar espacio: %s\n", strerror(errno));
+    }
+}
+
+void punch_hole(
+    int archive_fd, // Descriptor del archivo tar
+    off_t offset, // Inicio de la región
+    off_t length // Tamaño de la región
+) {
+    // Liberar los bloques sin cambiar el tamaño del archivo; la región se lee como ceros
+    if (length > 0 && fallocate(archive_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == -1
+        && verbose_level >= VERBOSE_DETAILED) {
+        printf("\tNo se pudo liberar espacio: %s\n", strerror(errno));
+    }
+}
+
+int load_file_infos(
+    FILE *archive, // Archivo tar
+    FileInfo **file_infos, // Puntero donde se guardará el arreglo de cabeceras (liberar con free)
+    bool legacy // Cabeceras del formato anterior
+) {
+    ArchiveMetadata metadata;
+    fseek(archive, METADATA_POSITION, SEEK_SET);
+    if (fread(&metadata, sizeof(ArchiveMetadata), 1, archive) != 1) {
+        *file_infos = NULL;
+        return -1;
+    }
+    *file_infos = malloc(sizeof(FileInfo) * (metadata.num_files > 0 ? metadata.num_files : 1));
+
+    // Recorrer las cabeceras saltando el contenido de cada archivo
+    int count = 0;
+    for (int i = 0; i < metadata.num_files; i++) {
+        if (!read_file_info(archive, &(*file_infos)[count], legacy)) {
+            break;
+        }
+        fseek(archive, (*file_infos)[count].file_size, SEEK_CUR);
+        count++;
+    }
+    return count;
+}
+
+bool load_volume_manifest(
+    const char *archive_name, // Nombre del archivo tar
+    VolumeManifest *manifest // Estructura donde se guardará el manifiesto
+) {
+    FILE *archive = fopen(archive_name, "rb");
+    if (!archive) {
+        return false;
+    }
+    int marker = 0;
+    bool is_manifest = fread(&marker, sizeof(int), 1, archive) == 1
+        && marker == VOLUME_MANIFEST_MARKER
+        && fseek(archive, METADATA_POSITION, SEEK_SET) == 0
+        && fread(manifest, sizeof(VolumeManifest), 1, archive) == 1
+        && manifest->num_volumes > 0 && manifest->num_volumes <= MAX_VOLUMES;
+    fclose(archive);
+    // Los nombres relativos se guardan respecto al directorio del manifiesto
+    for (int v = 0; is_manifest && v < manifest->num_volumes; v++) {
+        char stored_name[255];
+        strncpy(stored_name, manifest->volume_names[v], 255);
+        stored_name[255 - 1] = '\0';
+        resolve_volume_name(archive_name, stored_name, manifest->volume_names[v]);
+    }
+    return is_manifest;
+}
+
+bool reject_volume_manifest(
+    const char *archive_name // Nombre del archivo tar
+) {
+    // El manifiesto solo guarda la lista de volúmenes; los archivos se modifican en cada volumen
+    VolumeManifest manifest;
+    if (load_volume_manifest(archive_name, &manifest)) {
+        printf("El archivo %s es un manifiesto de volúmenes; esta operación se hace sobre cada volumen.\n", archive_name);
+        exit_status = 1;
+        return true;
+    }
+    return false;
+}
+
+bool check_archive_format(
+    int archive_fd, // Descriptor del archivo tar
+    const char *archive_name, // Nombre del archivo tar
+    bool *legacy // NULL si la operación solo admite el formato actual; si no, indica si el archivo es del formato anterior
+) {
+    // El primer entero identifica el formato; los archivos anteriores tienen 0 y cabeceras sin permisos ni fecha.
+    // Esos se pueden leer (-t, -x, --cat, y -A para copiarlos a un archivo nuevo) pero no modificar
+    int marker = 0;
+    bool readable = pread(archive_fd, &marker, sizeof(int), 0) == sizeof(int);
+    if (legacy) {
+        *legacy = false;
+    }
+    if (readable && marker == ARCHIVE_FORMAT_MARKER) {
+        return true;
+    }
+    if (readable && marker == 0 && legacy) {
+        *legacy = true;
+        return true;
+    }
+    FILE *messages = raw_output ? stderr : stdout;
+    if (!readable) {
+        fprintf(messages, "El archivo %s no es un archivo de star.\n", archive_name);
+    } else if (marker == VOLUME_MANIFEST_MARKER) {
+        fprintf(messages, "El archivo %s es un manifiesto de volúmenes; esta operación se hace sobre cada volumen.\n", archive_name);
+    } else if (marker == 0) {
+        fprintf(messages, "El archivo %s tiene el formato anterior, sin permisos ni fecha de modificación, y solo se puede leer; "
+                "para convertirlo use ./star -c nuevo.star y ./star -A nuevo.star %s\n", archive_name, archive_name);
+    } else {
+        fprintf(messages, "El archivo %s no es un archivo de star.\n", archive_name);
+    }
+    exit_status = 1;
+    return false;
+}
+
+bool read_file_info(
+    FILE *archive, // Archivo tar, posicionado en una cabecera
+    FileInfo *file_info, // Estructura donde se guardará la cabecera
+    bool legacy // La cabecera es del formato anterior, sin permisos ni fecha
+) {
+    if (!legacy) {
+        return fread(file_info, sizeof(FileInfo), 1, archive) == 1;
+    }
+    LegacyFileInfo legacy_info;
+    if (fread(&legacy_info, sizeof(LegacyFileInfo), 1, archive) != 1) {
+        return false;
+    }
+    memset(file_info, 0, sizeof(FileInfo));
+    memcpy(file_info->filename, legacy_info.filename, sizeof(legacy_info.filename));
+    file_info->file_size = legacy_info.file_size;
+    file_info->start_position = legacy_info.start_position;
+    file_info->status = legacy_info.status;
+    return true;
+}
+
+void resolve_volume_name(
+    const char *archive_name, // Nombre del manifiesto
+    const char *stored_name, // Nombre del volumen guardado en el manifiesto
+    char resolved_name[255] // Nombre del volumen respecto al directorio actual
+) {
+    const char *last_slash = strrchr(archive_name, '/');
+    if (stored_name[0] == '/' || !last_slash) {
+        snprintf(resolved_name, 255, "%s", stored_name);
+    } else {
+        snprintf(resolved_name, 255, "%.*s/%s", (int)(last_slash - archive_name), archive_name, stored_name);
+    }
+}
+
+void run_volume_tasks(
+    VolumeTask tasks[], // Tareas, una por volumen
+    int num_tasks, // Número de tareas
+    void *(*task_function)(void *) // Función que procesa un volumen
+) {
+    // Un hilo por volumen para que cada disco trabaje en paralelo
+    pthread_t threads[MAX_VOLUMES];
+    bool started[MAX_VOLUMES];
+    for (int v = 0; v < num_tasks; v++) {
+        started[v] = pthread_create(&threads[v], NULL, task_function, &tasks[v]) == 0;
+        if (!started[v]) {
+            task_function(&tasks[v]);
+        }
+    }
+    for (int v = 0; v < num_tasks; v++) {
+        if (started[v]) {
+            pthread_join(threads[v], NULL);
+        }
+    }
+}
+
+void append(
+    const char *archive_name, // Nombre del archivo de destino
+    const char *file_to_add // Nombre del archivo a añadir
+) {
+    if (reject_volume_manifest(archive_name)) {
+        return;
+    }
+    FILE *archive = fopen(archive_name, "rb+");
+    if (!archive) {
+        printf("Error al abrir el archivo %s\n", archive_name);
+        return;
+    }
+    if (!check_archive_format(fileno(archive), archive_name, NULL)) {
+        fclose(archive);
+        return;
+    }
+    // Bloquear la cabecera para no interferir con escritores concurrentes
+    if (!lock_archive_header(fileno(archive), F_WRLCK)) {
+        fclose(archive);
+        return;
+    }
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tArchivo %s abierto con éxito para añadir.\n", archive_name);
     }
 
     // Abrir el archivo a añadir
@@ -596,151 +1877,1442 @@ void append(
     FreeSpaceInfo free_spaces[MAX_FREE_SPACES];
     load_free_spaces(archive, free_spaces);
 
-    // Buscar primer espacio libre suficientemente grande usando First Fit
-    int index_found = -1;
-    for (int i = 0; i < MAX_FREE_SPACES; i++) {
-        if (free_spaces[i].size >= file_size + sizeof(FileInfo)) {
-            index_found = i;
+    // Buscar primer espacio libre suficientemente grande usando First Fit
+    int entries_delta = 1;
+    int start_position = take_free_space(archive, free_spaces, file_size + sizeof(FileInfo), &entries_delta);
+    if (start_position != -1) {
+        fseek(archive, start_position, SEEK_SET);
+    } else {
+        // Si no se encuentra un espacio libre adecuado, añadir al final
+        fseek(archive, 0, SEEK_END);
+        start_position = ftell(archive);
+        preallocate_range(fileno(archive), start_position, file_size + sizeof(FileInfo));
+    }
+
+    // Escribir información de archivo en el archivo de destino
+    FileInfo file_info;
+    memset(&file_info, 0, sizeof(FileInfo));
+    strncpy(file_info.filename, file_to_add, 255);
+    file_info.filename[255 - 1] = '\0';
+    file_info.file_size = file_size;
+    file_info.status = ACTIVE;
+    file_info.start_position = start_position + sizeof(FileInfo);
+    struct stat file_stat;
+    fstat(fileno(file), &file_stat);
+    file_info.mode = file_stat.st_mode & 07777;
+    file_info.mtime = file_stat.st_mtime;
+
+    // Escribir contenido y cabecera del archivo en el archivo de destino
+    if (write_member(archive, fileno(file), &file_info, free_spaces) && verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tContenido del archivo %s añadido en el archivo de destino.\n", file_to_add);
+    }
+
+    // Actualizar metadatos y espacios libres
+    fseek(archive, sizeof(int) + sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, SEEK_SET);
+    ArchiveMetadata metadata;
+    fread(&metadata, sizeof(ArchiveMetadata), 1, archive);
+    metadata.num_files += entries_delta;
+    fseek(archive, sizeof(int) + sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, SEEK_SET);
+    fwrite(&metadata, sizeof(ArchiveMetadata), 1, archive);
+
+    save_free_spaces(archive, free_spaces);
+
+    // Cerrar archivos y liberar memoria
+    fclose(file);
+    fclose(archive);
+}
+
+void append_concurrent(
+    const char *archive_name, // Nombre del archivo de destino
+    const char *file_to_add // Nombre del archivo a añadir
+) {
+    if (reject_volume_manifest(archive_name)) {
+        return;
+    }
+    int archive_fd = open(archive_name, O_RDWR);
+    if (archive_fd == -1) {
+        printf("Error al abrir el archivo %s\n", archive_name);
+        return;
+    }
+    if (!check_archive_format(archive_fd, archive_name, NULL)) {
+        close(archive_fd);
+        return;
+    }
+    int file_fd = open(file_to_add, O_RDONLY);
+    if (file_fd == -1) {
+        printf("Error al abrir el archivo %s\n", file_to_add);
+        close(archive_fd);
+        return;
+    }
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tArchivo %s abierto con éxito para añadir en modo concurrente.\n", archive_name);
+    }
+
+    // Obtener tamaño del archivo a añadir
+    struct stat file_stat;
+    fstat(file_fd, &file_stat);
+    int file_size = file_stat.st_size;
+    if (verbose_level >= VERBOSE_DETAILED) {
+        printf("\tTamaño del archivo %s a añadir: %d bytes.\n", file_to_add, file_size);
+    }
+
+    // Sección crítica: reservar la región al final del archivo y contarla en la metadata.
+    // El tamaño del archivo actúa como registro de reserva, por eso se extiende antes de liberar el bloqueo.
+    // La región queda bloqueada hasta publicar la cabecera, para que --pack no la mueva ni la descarte.
+    if (!lock_archive_header(archive_fd, F_WRLCK)) {
+        close(file_fd);
+        close(archive_fd);
+        return;
+    }
+    struct stat archive_stat;
+    fstat(archive_fd, &archive_stat);
+    off_t start_position = archive_stat.st_size;
+
+    FileInfo file_info;
+    memset(&file_info, 0, sizeof(FileInfo));
+    strncpy(file_info.filename, file_to_add, 255);
+    file_info.filename[255 - 1] = '\0';
+    file_info.file_size = file_size;
+    file_info.status = RESERVED;
+    file_info.start_position = start_position + sizeof(FileInfo);
+    file_info.mode = file_stat.st_mode & 07777;
+    file_info.mtime = file_stat.st_mtime;
+
+    ArchiveMetadata metadata;
+    preallocate_range(archive_fd, start_position, sizeof(FileInfo) + file_size);
+    bool reserved = ftruncate(archive_fd, start_position + sizeof(FileInfo) + file_size) == 0
+        && pwrite(archive_fd, &file_info, sizeof(FileInfo), start_position) == sizeof(FileInfo)
+        && lock_reserved_region(archive_fd, &file_info)
+        && pread(archive_fd, &metadata, sizeof(ArchiveMetadata), METADATA_POSITION) == sizeof(ArchiveMetadata);
+    if (reserved) {
+        metadata.num_files++;
+        reserved = pwrite(archive_fd, &metadata, sizeof(ArchiveMetadata), METADATA_POSITION) == sizeof(ArchiveMetadata);
+    }
+    lock_archive_header(archive_fd, F_UNLCK);
+    if (!reserved) {
+        printf("Error al reservar espacio para %s en %s\n", file_to_add, archive_name);
+        close(file_fd);
+        close(archive_fd);
+        return;
+    }
+    if (verbose_level >= VERBOSE_DETAILED) {
+        printf("\tRegión reservada para %s en la posición %ld.\n", file_to_add, (long)start_position);
+    }
+
+    // Copiar el contenido fuera de la sección crítica, en paralelo con otros escritores
+    if (!copy_range(file_fd, 0, archive_fd, file_info.start_position, file_size)) {
+        printf("Error al copiar el contenido de %s; la región queda reservada hasta el próximo --pack.\n", file_to_add);
+        close(file_fd);
+        close(archive_fd);
+        return;
+    }
+
+    // Publicar la cabecera: a partir de aquí el archivo es visible para los lectores.
+    // Bajo el bloqueo se comprueba que la reserva sigue en su lugar
+    FileInfo reserved_info;
+    bool published = lock_archive_header(archive_fd, F_WRLCK)
+        && pread(archive_fd, &reserved_info, sizeof(FileInfo), start_position) == sizeof(FileInfo)
+        && reserved_info.status == RESERVED
+        && reserved_info.start_position == file_info.start_position
+        && strcmp(reserved_info.filename, file_info.filename) == 0;
+    if (published) {
+        file_info.status = ACTIVE;
+        published = pwrite(archive_fd, &file_info, sizeof(FileInfo), start_position) == sizeof(FileInfo);
+    }
+    lock_archive_header(archive_fd, F_UNLCK);
+    if (!published) {
+        printf("Error: la reserva de %s en %s ya no es válida; el archivo no fue añadido.\n", file_to_add, archive_name);
+        close(file_fd);
+        close(archive_fd);
+        return;
+    }
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tContenido del archivo %s añadido en el archivo de destino.\n", file_to_add);
+    }
+
+    close(file_fd);
+    close(archive_fd);
+}
+void defragment(
+    const char *archive_name
+) {
+    if (reject_volume_manifest(archive_name)) {
+        return;
+    }
+    // Abrir el archivo tar
+    FILE *archive = fopen(archive_name, "rb+");
+    if (!archive) {
+        printf("Error al abrir el archivo %s\n", archive_name);
+        return;
+    }
+    if (!check_archive_format(fileno(archive), archive_name, NULL)) {
+        fclose(archive);
+        return;
+    }
+    // Bloquear la cabecera para no interferir con escritores concurrentes
+    if (!lock_archive_header(fileno(archive), F_WRLCK)) {
+        fclose(archive);
+        return;
+    }
+
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("Iniciando defragmentación del archivo %s...\n", archive_name);
+    }
+    int archive_fd = fileno(archive);
+
+    // Leer metadatos del archivo
+    ArchiveMetadata metadata;
+    pread(archive_fd, &metadata, sizeof(ArchiveMetadata), METADATA_POSITION);
+
+    // Los archivos activos se mueven hacia el inicio. Una región reservada cuyo escritor sigue copiando
+    // no se mueve: el hueco anterior se cubre con una cabecera borrada y pasa a la lista de espacios libres
+    FreeSpaceInfo free_spaces[MAX_FREE_SPACES];
+    memset(&free_spaces, 0, sizeof(FreeSpaceInfo) * MAX_FREE_SPACES);
+    int num_entries = 0;
+    off_t read_position = HEADER_SIZE;
+    off_t write_position = HEADER_SIZE;
+
+    for (int i = 0; i < metadata.num_files; i++) {
+        FileInfo file_info;
+        if (pread(archive_fd, &file_info, sizeof(FileInfo), read_position) != sizeof(FileInfo)) {
+            break;
+        }
+        off_t next_position = read_position + sizeof(FileInfo) + file_info.file_size;
+
+        if (file_info.status == ACTIVE) {
+            num_entries++;
+            if (write_position != read_position) {
+                // Mover el contenido y escribir la cabecera con la nueva posición de inicio
+                if (!copy_range(archive_fd, file_info.start_position, archive_fd, write_position + sizeof(FileInfo), file_info.file_size)) {
+                    printf("Error al mover el archivo %s\n", file_info.filename);
+                }
+                file_info.start_position = write_position + sizeof(FileInfo);
+                pwrite(archive_fd, &file_info, sizeof(FileInfo), write_position);
+            }
+            write_position += sizeof(FileInfo) + file_info.file_size;
+        } else if (file_info.status == RESERVED && reservation_in_use(archive_fd, &file_info)) {
+            if (write_position < read_position) {
+                FileInfo filler;
+                memset(&filler, 0, sizeof(FileInfo));
+                filler.file_size = read_position - write_position - sizeof(FileInfo);
+                filler.start_position = write_position + sizeof(FileInfo);
+                filler.status = DELETED;
+                pwrite(archive_fd, &filler, sizeof(FileInfo), write_position);
+                punch_hole(archive_fd, filler.start_position, filler.file_size);
+                FreeSpaceInfo gap;
+                gap.start_position = write_position;
+                gap.size = read_position - write_position;
+                insert_and_combine_free_space(free_spaces, gap);
+                num_entries++;
+            }
+            num_entries++;
+            write_position = next_position;
+            if (verbose_level >= VERBOSE_SIMPLE) {
+                printf("\tRegión reservada para %s en uso, se conserva en su posición.\n", file_info.filename);
+            }
+        } else if (file_info.status == RESERVED && verbose_level >= VERBOSE_SIMPLE) {
+            printf("\tReserva abandonada de %s descartada.\n", file_info.filename);
+        }
+        read_position = next_position;
+    }
+    // Actualizar metadatos y lista de espacios libres
+    metadata.num_files = num_entries;
+    pwrite(archive_fd, &metadata, sizeof(ArchiveMetadata), METADATA_POSITION);
+    pwrite(archive_fd, &free_spaces, sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, sizeof(int));
+
+    // Redimensionar el archivo al final de la escritura
+    ftruncate(archive_fd, write_position);
+
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("Defragmentación completada exitosamente para el archivo %s.\n", archive_name);
+    }
+
+    fclose(archive);
+}
+
+
+
+
+DiffKind diff_member(
+    int archive_fd, // Descriptor del archivo tar
+    const FileInfo *file_info, // Cabecera del archivo a comparar
+    long *value // Tamaño en disco o posición de la primera diferencia
+) {
+    // Primero la metadata: existencia y tamaño
+    struct stat file_stat;
+    if (stat(file_info->filename, &file_stat) != 0) {
+        return DIFF_MISSING;
+    }
+    if (file_stat.st_size != file_info->file_size) {
+        *value = file_stat.st_size;
+        return DIFF_SIZE;
+    }
+
+    // Después el contenido, en bloques grandes y terminando en el primer bloque distinto
+    int file_fd = open(file_info->filename, O_RDONLY);
+    if (file_fd == -1) {
+        return DIFF_READ_ERROR;
+    }
+    posix_fadvise(file_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    char *archive_buffer = malloc(COPY_BUFFER_SIZE);
+    char *file_buffer = malloc(COPY_BUFFER_SIZE);
+    DiffKind kind = DIFF_NONE;
+    for (long offset = 0; offset < file_info->file_size && kind == DIFF_NONE; offset += COPY_BUFFER_SIZE) {
+        size_t chunk = file_info->file_size - offset < COPY_BUFFER_SIZE ? file_info->file_size - offset : COPY_BUFFER_SIZE;
+        throttle_io(2 * chunk);
+        if (pread(archive_fd, archive_buffer, chunk, file_info->start_position + offset) != (ssize_t)chunk
+            || pread(file_fd, file_buffer, chunk, offset) != (ssize_t)chunk) {
+            kind = DIFF_READ_ERROR;
+        } else if (memcmp(archive_buffer, file_buffer, chunk) != 0) {
+            size_t j = 0;
+            while (archive_buffer[j] == file_buffer[j]) j++;
+            *value = offset + j;
+            kind = DIFF_CONTENT;
+        }
+    }
+    free(archive_buffer);
+    free(file_buffer);
+    close(file_fd);
+    if (kind == DIFF_NONE && ((file_stat.st_mode & 07777) != file_info->mode || file_stat.st_mtime != file_info->mtime)) {
+        kind = DIFF_METADATA;
+    }
+    return kind;
+}
+
+void *diff_task(void *argument) {
+    DiffTask *task = argument;
+    while (true) {
+        // Tomar el próximo archivo pendiente
+        pthread_mutex_lock(&task->lock);
+        int i = task->next_index++;
+        pthread_mutex_unlock(&task->lock);
+        if (i >= task->num_file_infos) {
+            break;
+        }
+        task->kinds[i] = diff_member(task->archive_fd, &task->file_infos[i], &task->values[i]);
+    }
+    return NULL;
+}
+
+int diff(
+    const char *archive_name, // Nombre del archivo tar
+    char *files[], // Archivos a comparar
+    int num_files // Número de archivos a comparar, 0 para comparar todos
+) {
+    // Un manifiesto de volúmenes se compara volumen por volumen
+    bool *matched = calloc(num_files > 0 ? num_files : 1, sizeof(bool));
+    int differences = 0;
+    VolumeManifest manifest;
+    if (load_volume_manifest(archive_name, &manifest)) {
+        for (int v = 0; v < manifest.num_volumes; v++) {
+            differences += diff_archive(manifest.volume_names[v], files, num_files, matched);
+        }
+    } else {
+        differences = diff_archive(archive_name, files, num_files, matched);
+    }
+
+    // Un nombre pedido que no está en el archivo no está respaldado: también es una diferencia
+    for (int j = 0; j < num_files; j++) {
+        if (!matched[j]) {
+            printf("%s: no existe en el archivo.\n", files[j]);
+            differences++;
+        }
+    }
+    free(matched);
+    return differences;
+}
+
+int diff_archive(
+    const char *archive_name, // Nombre del archivo tar o volumen
+    char *files[], // Archivos a comparar
+    int num_files, // Número de archivos a comparar, 0 para comparar todos
+    bool matched[] // Marca los archivos pedidos que se encontraron
+) {
+    FILE *archive = fopen(archive_name, "rb");
+    if (!archive) {
+        printf("Error al abrir el archivo %s\n", archive_name);
+        return 1;
+    }
+    if (!check_archive_format(fileno(archive), archive_name, NULL)) {
+        fclose(archive);
+        return 1;
+    }
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tArchivo %s abierto con éxito.\n", archive_name);
+    }
+
+    // Quedarse con los archivos activos solicitados
+    FileInfo *file_infos;
+    int num_file_infos = load_file_infos(archive, &file_infos, false);
+    int count = 0;
+    for (int i = 0; i < num_file_infos; i++) {
+        if (file_infos[i].status != ACTIVE) {
+            continue;
+        }
+        bool requested = num_files == 0;
+        for (int j = 0; j < num_files; j++) {
+            if (strcmp(files[j], file_infos[i].filename) == 0) {
+                requested = true;
+                matched[j] = true;
+            }
+        }
+        if (requested) {
+            file_infos[count++] = file_infos[i];
+        }
+    }
+
+    // Comparar en paralelo; los resultados se imprimen después, en el orden del archivo
+    DiffTask task;
+    task.archive_fd = fileno(archive);
+    task.file_infos = file_infos;
+    task.num_file_infos = count;
+    task.kinds = calloc(count > 0 ? count : 1, sizeof(DiffKind));
+    task.values = calloc(count > 0 ? count : 1, sizeof(long));
+    task.next_index = 0;
+    pthread_mutex_init(&task.lock, NULL);
+    int num_workers = num_threads < count ? num_threads : count;
+    pthread_t *threads = malloc(sizeof(pthread_t) * (num_workers > 0 ? num_workers : 1));
+    int started = 0;
+    for (int t = 0; t < num_workers; t++) {
+        if (pthread_create(&threads[started], NULL, diff_task, &task) == 0) {
+            started++;
+        }
+    }
+    if (started == 0) {
+        diff_task(&task);
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&task.lock);
+
+    // Reportar solo las diferencias
+    int differences = 0;
+    for (int i = 0; i < count; i++) {
+        const char *name = file_infos[i].filename;
+        switch (task.kinds[i]) {
+            case DIFF_NONE:
+                break;
+            case DIFF_MISSING:
+                printf("%s: no existe en disco.\n", name);
+                break;
+            case DIFF_SIZE:
+                printf("%s: tamaño distinto (archivo: %d bytes, disco: %ld bytes).\n", name, file_infos[i].file_size, task.values[i]);
+                break;
+            case DIFF_CONTENT:
+                printf("%s: contenido distinto a partir del byte %ld.\n", name, task.values[i]);
+                break;
+            case DIFF_READ_ERROR:
+                printf("%s: error al leer el contenido.\n", name);
+                break;
+            case DIFF_METADATA:
+                printf("%s: permisos o fecha de modificación distintos.\n", name);
+                break;
+        }
+        if (task.kinds[i] != DIFF_NONE) {
+            differences++;
+        }
+    }
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\t%d archivos comparados, %d con diferencias.\n", count, differences);
+    }
+
+    free(task.kinds);
+    free(task.values);
+    free(file_infos);
+    fclose(archive);
+    return differences;
+}
+
+bool cat_member(
+    const char *archive_name, // Nombre del archivo tar
+    const char *member_name, // Nombre del archivo a leer
+    long offset, // Primer byte a leer dentro del archivo
+    long length, // Bytes a leer, -1 para leer hasta el final
+    int out_fd // Descriptor donde se escribe el rango
+) {
+    // En un manifiesto se busca el archivo en cada volumen
+    VolumeManifest manifest;
+    if (load_volume_manifest(archive_name, &manifest)) {
+        for (int v = 0; v < manifest.num_volumes; v++) {
+            if (cat_member(manifest.volume_names[v], member_name, offset, length, out_fd)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    FILE *archive = fopen(archive_name, "rb");
+    if (!archive) {
+        fprintf(stderr, "Error al abrir el archivo %s\n", archive_name);
+        return false;
+    }
+    bool legacy;
+    if (!check_archive_format(fileno(archive), archive_name, &legacy)) {
+        fclose(archive);
+        return false;
+    }
+    FileInfo file_info;
+    if (!find_file_info(archive, member_name, &file_info, legacy)) {
+        fclose(archive);
+        return false;
+    }
+
+    // Ajustar el rango al tamaño del archivo y copiar solo ese rango
+    if (offset > file_info.file_size) {
+        offset = file_info.file_size;
+    }
+    if (length < 0 || length > file_info.file_size - offset) {
+        length = file_info.file_size - offset;
+    }
+    if (verbose_level >= VERBOSE_DETAILED) {
+        fprintf(stderr, "\tLeyendo %ld bytes de %s desde la posición %ld.\n", length, member_name, file_info.start_position + offset);
+    }
+    fflush(stdout);
+    bool copied = copy_range(fileno(archive), file_info.start_position + offset, out_fd, -1, length);
+    if (!copied) {
+        fprintf(stderr, "Error al leer el archivo %s\n", member_name);
+    }
+    fclose(archive);
+    return copied;
+}
+
+bool cat(
+    const char *archive_name, // Nombre del archivo tar
+    const char *member_spec // archivo[:posición[:largo]]
+) {
+    // Separar posición y largo desde la derecha; solo se toman si son números
+    char member_name[255];
+    snprintf(member_name, sizeof(member_name), "%s", member_spec);
+    long numbers[2];
+    int count = 0;
+    while (count < 2) {
+        char *colon = strrchr(member_name, ':');
+        if (!colon || colon[1] == '\0' || strspn(colon + 1, "0123456789") != strlen(colon + 1)) {
+            break;
+        }
+        numbers[count++] = atol(colon + 1);
+        *colon = '\0';
+    }
+    long offset = count == 1 ? numbers[0] : count == 2 ? numbers[1] : 0;
+    long length = count == 2 ? numbers[0] : -1;
+
+    // Termina con el resultado de la copia para que main devuelva un estado distinto de 0
+    bool found = cat_member(archive_name, member_name, offset, length, STDOUT_FILENO);
+    if (!found) {
+        fprintf(stderr, "El archivo %s no fue encontrado en el archivo.\n", member_name);
+    }
+    return found;
+}
+
+void catenate_index_rebuild(
+    CatenateTarget *target // Estado del destino
+) {
+    // Tabla con al menos el doble de posiciones que cabeceras, para que las búsquedas terminen en una posición libre
+    int size = 64;
+    while (size < target->num_file_infos * 2 + 2) size *= 2;
+    free(target->index);
+    target->index = malloc(sizeof(int) * size);
+    target->index_size = size;
+    for (int i = 0; i < size; i++) {
+        target->index[i] = -1;
+    }
+    for (int m = 0; m < target->num_file_infos; m++) {
+        if (target->file_infos[m].status == ACTIVE) {
+            unsigned int slot = hash_name(target->file_infos[m].filename) & (size - 1);
+            while (target->index[slot] != -1) slot = (slot + 1) & (size - 1);
+            target->index[slot] = m;
+        }
+    }
+}
+
+void catenate_index_add(
+    CatenateTarget *target, // Estado del destino
+    int member // Posición del archivo recién añadido en file_infos
+) {
+    if (target->num_file_infos * 2 > target->index_size) {
+        catenate_index_rebuild(target);
+        return;
+    }
+    unsigned int slot = hash_name(target->file_infos[member].filename) & (target->index_size - 1);
+    while (target->index[slot] != -1) slot = (slot + 1) & (target->index_size - 1);
+    target->index[slot] = member;
+}
+
+int find_catenate_member(
+    const CatenateTarget *target, // Estado del destino
+    const char *filename // Nombre a buscar
+) {
+    // Los archivos reemplazados quedan en la tabla marcados como DELETED y se saltan
+    unsigned int slot = hash_name(filename) & (target->index_size - 1);
+    while (target->index[slot] != -1) {
+        int m = target->index[slot];
+        if (target->file_infos[m].status == ACTIVE && strcmp(target->file_infos[m].filename, filename) == 0) {
+            return m;
+        }
+        slot = (slot + 1) & (target->index_size - 1);
+    }
+    return -1;
+}
+
+void catenate_source(
+    CatenateTarget *target, // Estado del destino
+    const char *source_name // Nombre del archivo tar a añadir
+) {
+    // El destino no puede ser una fuente: abrirlo y cerrarlo otra vez liberaría el bloqueo de su cabecera
+    struct stat source_stat;
+    struct stat target_stat;
+    if (stat(source_name, &source_stat) == 0 && fstat(target->archive_fd, &target_stat) == 0
+        && source_stat.st_dev == target_stat.st_dev && source_stat.st_ino == target_stat.st_ino) {
+        printf("El archivo %s es el mismo archivo de destino, se omite.\n", source_name);
+        return;
+    }
+
+    // Los manifiestos se añaden volumen por volumen
+    VolumeManifest manifest;
+    if (load_volume_manifest(source_name, &manifest)) {
+        for (int v = 0; v < manifest.num_volumes; v++) {
+            catenate_source(target, manifest.volume_names[v]);
+        }
+        return;
+    }
+
+    FILE *source = fopen(source_name, "rb");
+    if (!source) {
+        printf("Error al abrir el archivo %s\n", source_name);
+        return;
+    }
+    bool legacy;
+    if (!check_archive_format(fileno(source), source_name, &legacy)) {
+        fclose(source);
+        return;
+    }
+    FileInfo *source_infos;
+    int num_source_infos = load_file_infos(source, &source_infos, legacy);
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tAñadiendo archivos de %s.\n", source_name);
+    }
+
+    for (int i = 0; i < num_source_infos; i++) {
+        FileInfo file_info = source_infos[i];
+        // Los archivos borrados o sin publicar no se copian
+        if (file_info.status != ACTIVE) {
+            continue;
+        }
+
+        // Resolver colisiones de nombres según --on-conflict; el reemplazo se hace después de copiar
+        int existing = find_catenate_member(target, file_info.filename);
+        int replaced = -1;
+        if (existing != -1 && conflict_policy == CONFLICT_SKIP) {
+            printf("El archivo %s ya existe en el destino, se omite.\n", file_info.filename);
+            continue;
+        } else if (existing != -1 && conflict_policy == CONFLICT_REPLACE) {
+            replaced = existing;
+        } else if (existing != -1) {
+            char renamed[255];
+            for (int suffix = 1; existing != -1; suffix++) {
+                snprintf(renamed, sizeof(renamed), "%.*s.%d", 240, file_info.filename, suffix);
+                existing = find_catenate_member(target, renamed);
+            }
+            if (verbose_level >= VERBOSE_SIMPLE) {
+                printf("\tArchivo %s renombrado a %s.\n", file_info.filename, renamed);
+            }
+            strncpy(file_info.filename, renamed, 255);
+        }
+
+        // Copiar el contenido dentro del kernel y escribir la cabecera con la nueva posición solo después.
+        // Si falla, se descarta lo escrito para que el próximo -r no quede dentro de una región a medias
+        off_t header_position = target->tail_position;
+        off_t source_position = file_info.start_position;
+        file_info.start_position = header_position + sizeof(FileInfo);
+        preallocate_range(target->archive_fd, header_position, sizeof(FileInfo) + file_info.file_size);
+        if (!copy_range_kernel(fileno(source), source_position, target->archive_fd, file_info.start_position, file_info.file_size)
+            || pwrite(target->archive_fd, &file_info, sizeof(FileInfo), header_position) != sizeof(FileInfo)) {
+            printf("Error al copiar el archivo %s desde %s\n", file_info.filename, source_name);
+            ftruncate(target->archive_fd, header_position);
             break;
         }
-    }
+        target->tail_position = file_info.start_position + file_info.file_size;
+        target->added_files++;
 
-    int start_position;
-    if (index_found != -1) {
-        // Usar el espacio libre encontrado
-        start_position = free_spaces[index_found].start_position;
-        free_spaces[index_found].start_position += file_size + sizeof(FileInfo);
-        free_spaces[index_found].size -= (file_size + sizeof(FileInfo));
-        if (free_spaces[index_found].size == 0) {
-            memset(&free_spaces[index_found], 0, sizeof(FreeSpaceInfo));
+        if (target->num_file_infos == target->capacity) {
+            target->capacity *= 2;
+            target->file_infos = realloc(target->file_infos, sizeof(FileInfo) * target->capacity);
+            target->header_positions = realloc(target->header_positions, sizeof(off_t) * target->capacity);
+        }
+        target->file_infos[target->num_file_infos] = file_info;
+        target->header_positions[target->num_file_infos] = header_position;
+        target->num_file_infos++;
+        catenate_index_add(target, target->num_file_infos - 1);
+
+        // La copia anterior se borra solo cuando la nueva ya está completa
+        if (replaced != -1) {
+            FileInfo *old_info = &target->file_infos[replaced];
+            old_info->status = DELETED;
+            pwrite(target->archive_fd, old_info, sizeof(FileInfo), target->header_positions[replaced]);
+            FreeSpaceInfo new_free_space;
+            new_free_space.start_position = target->header_positions[replaced];
+            new_free_space.size = old_info->file_size + sizeof(FileInfo);
+            insert_and_combine_free_space(target->free_spaces, new_free_space);
+            punch_hole(target->archive_fd, old_info->start_position, old_info->file_size);
+            if (verbose_level >= VERBOSE_DETAILED) {
+                printf("\tArchivo %s del destino marcado como eliminado.\n", file_info.filename);
+            }
+        }
+        if (verbose_level >= VERBOSE_SIMPLE) {
+            printf("\tArchivo %s añadido.\n", file_info.filename);
         }
-        fseek(archive, start_position, SEEK_SET);
-    } else {
-        // Si no se encuentra un espacio libre adecuado, añadir al final
-        fseek(archive, 0, SEEK_END);
-        start_position = ftell(archive);
     }
 
-    // Escribir información de archivo en el archivo de destino
-    FileInfo file_info;
-    strncpy(file_info.filename, file_to_add, 255);
-    file_info.filename[255 - 1] = '\0';
-    file_info.file_size = file_size;
-    file_info.status = ACTIVE;
-    file_info.start_position = start_position + sizeof(FileInfo);
-    fwrite(&file_info, sizeof(FileInfo), 1, archive);
-
-    // Escribir contenido del archivo en el archivo de destino
-    char *buffer = malloc(file_size);
-    fread(buffer, file_size, 1, file);
-    fwrite(buffer, file_size, 1, archive);
-    free(buffer); // Libera el buffer después de usarlo.
+    free(source_infos);
+    fclose(source);
+}
 
-    if (index_found != -1) {
-        // Si se utilizó un espacio libre, verifica si hay que rellenar
-        int remaining_space = free_spaces[index_found].size;
-        if (remaining_space > 0) {
-            char *fill_buffer = malloc(remaining_space);
-            memset(fill_buffer, 0, remaining_space);
-            fwrite(fill_buffer, remaining_space, 1, archive);
-            free(fill_buffer);
-        }
+void catenate(
+    const char *archive_name, // Nombre del archivo de destino
+    char *sources[], // Archivos tar a añadir
+    int num_sources // Número de archivos tar a añadir
+) {
+    if (reject_volume_manifest(archive_name)) {
+        return;
+    }
+    FILE *archive = fopen(archive_name, "rb+");
+    if (!archive) {
+        printf("Error al abrir el archivo %s\n", archive_name);
+        return;
+    }
+    if (!check_archive_format(fileno(archive), archive_name, NULL)) {
+        fclose(archive);
+        return;
+    }
+    // Bloquear la cabecera para no interferir con escritores concurrentes
+    if (!lock_archive_header(fileno(archive), F_WRLCK)) {
+        fclose(archive);
+        return;
     }
     if (verbose_level >= VERBOSE_SIMPLE) {
-        printf("\tContenido del archivo %s añadido en el archivo de destino.\n", file_to_add);
+        printf("\tArchivo %s abierto con éxito para concatenar.\n", archive_name);
     }
 
-    // Actualizar metadatos y espacios libres
-    fseek(archive, sizeof(int) + sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, SEEK_SET);
-    ArchiveMetadata metadata;
-    fread(&metadata, sizeof(ArchiveMetadata), 1, archive);
-    metadata.num_files++;
-    fseek(archive, sizeof(int) + sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, SEEK_SET);
-    fwrite(&metadata, sizeof(ArchiveMetadata), 1, archive);
+    // Cargar cabeceras, espacios libres y el final actual del destino
+    CatenateTarget target;
+    target.archive_fd = fileno(archive);
+    FileInfo *file_infos;
+    target.num_file_infos = load_file_infos(archive, &file_infos, false);
+    if (target.num_file_infos < 0) {
+        printf("Error al leer metadatos.\n");
+        fclose(archive);
+        return;
+    }
+    target.capacity = target.num_file_infos > 0 ? target.num_file_infos * 2 : 16;
+    target.file_infos = realloc(file_infos, sizeof(FileInfo) * target.capacity);
+    target.header_positions = malloc(sizeof(off_t) * target.capacity);
+    for (int i = 0; i < target.num_file_infos; i++) {
+        target.header_positions[i] = target.file_infos[i].start_position - sizeof(FileInfo);
+    }
+    target.index = NULL;
+    catenate_index_rebuild(&target);
+    target.added_files = 0;
+    load_free_spaces(archive, target.free_spaces);
+    struct stat archive_stat;
+    fstat(target.archive_fd, &archive_stat);
+    target.tail_position = archive_stat.st_size;
+
+    for (int i = 0; i < num_sources; i++) {
+        catenate_source(&target, sources[i]);
+    }
 
-    save_free_spaces(archive, free_spaces);
+    // Solo se reescriben la metadata y la lista de espacios libres
+    ArchiveMetadata metadata;
+    pread(target.archive_fd, &metadata, sizeof(ArchiveMetadata), METADATA_POSITION);
+    metadata.num_files += target.added_files;
+    pwrite(target.archive_fd, &metadata, sizeof(ArchiveMetadata), METADATA_POSITION);
+    pwrite(target.archive_fd, target.free_spaces, sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, sizeof(int));
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\t%d archivos añadidos a %s.\n", target.added_files, archive_name);
+    }
 
-    // Cerrar archivos y liberar memoria
-    fclose(file);
+    free(target.file_infos);
+    free(target.header_positions);
+    free(target.index);
     fclose(archive);
 }
-void defragment(
-    const char *archive_name
+
+unsigned int hash_name(const char *name) {
+    unsigned int hash = 2166136261u;
+    for (const char *c = name; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    return hash;
+}
+
+void served_index_rebuild(ServedArchive *served) {
+    // Tabla con al menos el doble de posiciones que archivos
+    int size = 64;
+    while (size < served->capacity * 2) size *= 2;
+    free(served->index);
+    served->index = malloc(sizeof(int) * size);
+    served->index_size = size;
+    for (int i = 0; i < size; i++) {
+        served->index[i] = -1;
+    }
+    for (int m = 0; m < served->num_members; m++) {
+        unsigned int slot = hash_name(served->members[m].filename) & (size - 1);
+        while (served->index[slot] != -1) slot = (slot + 1) & (size - 1);
+        served->index[slot] = m;
+    }
+    served->index_tombstones = 0;
+}
+
+int served_find(
+    const ServedArchive *served, // Archivo servido
+    const char *filename // Nombre a buscar
 ) {
-    // Abrir el archivo tar
-    int active_files_count = 0;
+    unsigned int slot = hash_name(filename) & (served->index_size - 1);
+    while (served->index[slot] != -1) {
+        int m = served->index[slot];
+        if (m >= 0 && strcmp(served->members[m].filename, filename) == 0) {
+            return m;
+        }
+        slot = (slot + 1) & (served->index_size - 1);
+    }
+    return -1;
+}
 
-    FILE *archive = fopen(archive_name, "rb+");
-    if (!archive) {
-        printf("Error al abrir el archivo %s\n", archive_name);
+void served_add(
+    ServedArchive *served, // Archivo servido
+    const FileInfo *file_info // Cabecera del archivo añadido
+) {
+    if (served->num_members == served->capacity) {
+        served->capacity *= 2;
+        served->members = realloc(served->members, sizeof(FileInfo) * served->capacity);
+        served->members[served->num_members++] = *file_info;
+        served_index_rebuild(served);
         return;
     }
+    served->members[served->num_members] = *file_info;
+    unsigned int slot = hash_name(file_info->filename) & (served->index_size - 1);
+    while (served->index[slot] >= 0) slot = (slot + 1) & (served->index_size - 1);
+    if (served->index[slot] == -2) {
+        served->index_tombstones--;
+    }
+    served->index[slot] = served->num_members++;
+    // Las búsquedas terminan en una posición -1: reconstruir antes de que las ocupadas y borradas pasen de la mitad
+    if ((served->num_members + served->index_tombstones) * 2 > served->index_size) {
+        served_index_rebuild(served);
+    }
+}
 
-    if (verbose_level >= VERBOSE_SIMPLE) {
-        printf("Iniciando defragmentación del archivo %s...\n", archive_name);
+void served_remove(
+    ServedArchive *served, // Archivo servido
+    int member // Posición del archivo en members
+) {
+    // Marcar la posición como borrada y mover el último archivo al hueco
+    unsigned int slot = hash_name(served->members[member].filename) & (served->index_size - 1);
+    while (served->index[slot] != member) slot = (slot + 1) & (served->index_size - 1);
+    served->index[slot] = -2;
+    served->index_tombstones++;
+    int last = --served->num_members;
+    if (member != last) {
+        slot = hash_name(served->members[last].filename) & (served->index_size - 1);
+        while (served->index[slot] != last) slot = (slot + 1) & (served->index_size - 1);
+        served->index[slot] = member;
+        served->members[member] = served->members[last];
     }
+}
 
-    // Saltar el número inicial de espacios libres
-    fseek(archive, sizeof(int), SEEK_SET);
+bool served_load(
+    ServedArchive *served // Archivo servido
+) {
+    // Un solo recorrido de cabeceras; después las consultas usan la memoria
+    FileInfo *file_infos;
+    int num_file_infos = load_file_infos(served->archive, &file_infos, false);
+    if (num_file_infos < 0) {
+        printf("Error al leer metadatos de %s.\n", served->name);
+        return false;
+    }
+    served->num_members = 0;
+    served->capacity = num_file_infos > 16 ? num_file_infos : 16;
+    free(served->members);
+    served->members = malloc(sizeof(FileInfo) * served->capacity);
+    for (int i = 0; i < num_file_infos; i++) {
+        if (file_infos[i].status == ACTIVE) {
+            served->members[served->num_members++] = file_infos[i];
+        }
+    }
+    free(file_infos);
+    served_index_rebuild(served);
+    load_free_spaces(served->archive, served->free_spaces);
+    pread(fileno(served->archive), &served->metadata, sizeof(ArchiveMetadata), METADATA_POSITION);
+
+    struct stat archive_stat;
+    fstat(fileno(served->archive), &archive_stat);
+    served->loaded_mtime = archive_stat.st_mtim;
+    served->loaded_size = archive_stat.st_size;
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tArchivo %s cargado: %d archivos activos.\n", served->name, served->num_members);
+    }
+    return true;
+}
 
-    // Saltar la lista de espacios libres
-    fseek(archive, sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, SEEK_CUR);
+void served_refresh(
+    ServedArchive *served // Archivo servido
+) {
+    // Si otro proceso modificó el archivo, volver a cargar las cabeceras
+    struct stat archive_stat;
+    fstat(fileno(served->archive), &archive_stat);
+    if (archive_stat.st_size != served->loaded_size
+        || archive_stat.st_mtim.tv_sec != served->loaded_mtime.tv_sec
+        || archive_stat.st_mtim.tv_nsec != served->loaded_mtime.tv_nsec) {
+        served_load(served);
+    }
+}
 
-    // Leer metadatos del archivo
-    ArchiveMetadata metadata;
-    fread(&metadata, sizeof(ArchiveMetadata), 1, archive);
+void serve_request(
+    ServeClient *client, // Conexión que hizo la solicitud
+    char *line // Solicitud: COMANDO archivo [argumentos]
+) {
+    char *save;
+    char *command = strtok_r(line, " \t\r\n", &save);
+    char *archive_name = strtok_r(NULL, " \t\r\n", &save);
+    char *argument = strtok_r(NULL, " \t\r\n", &save);
+    if (!command) {
+        return;
+    }
+    if (verbose_level >= VERBOSE_SIMPLE) {
+        printf("\tSolicitud: %s %s %s\n", command, archive_name ? archive_name : "", argument ? argument : "");
+    }
+    ServedArchive *served = NULL;
+    for (int i = 0; archive_name && i < client->num_archives; i++) {
+        if (strcmp(client->archives[i].name, archive_name) == 0) {
+            served = &client->archives[i];
+        }
+    }
+    if (!served) {
+        dprintf(client->client_fd, "ERR archivo no servido: %s\n", archive_name ? archive_name : "");
+        return;
+    }
 
-    int write_position = sizeof(int) + sizeof(FreeSpaceInfo) * MAX_FREE_SPACES + sizeof(ArchiveMetadata);
+    pthread_mutex_lock(&served->lock);
+    served_refresh(served);
+    int archive_fd = fileno(served->archive);
+    if (strcmp(command, "LIST") == 0) {
+        for (int m = 0; m < served->num_members; m++) {
+            dprintf(client->client_fd, "%s\t%d\n", served->members[m].filename, served->members[m].file_size);
+        }
+        dprintf(client->client_fd, "OK %d\n", served->num_members);
+    } else if (strcmp(command, "CAT") == 0 && argument) {
+        int m = served_find(served, argument);
+        if (m == -1) {
+            dprintf(client->client_fd, "ERR no encontrado: %s\n", argument);
+        } else {
+            // Rango opcional: posición y largo, ajustados al tamaño del archivo
+            char *offset_text = strtok_r(NULL, " \t\r\n", &save);
+            char *length_text = strtok_r(NULL, " \t\r\n", &save);
+            long size = served->members[m].file_size;
+            long offset = offset_text ? atol(offset_text) : 0;
+            if (offset < 0 || offset > size) offset = size;
+            long length = length_text ? atol(length_text) : -1;
+            if (length < 0 || length > size - offset) length = size - offset;
+            dprintf(client->client_fd, "OK %ld\n", length);
+            copy_range(archive_fd, served->members[m].start_position + offset, client->client_fd, -1, length);
+        }
+    } else if (strcmp(command, "APPEND") == 0 && argument) {
+        int file_fd = open(argument, O_RDONLY);
+        struct stat file_stat;
+        if (file_fd == -1 || fstat(file_fd, &file_stat) != 0) {
+            dprintf(client->client_fd, "ERR no se pudo abrir: %s\n", argument);
+        } else if (lock_archive_header(archive_fd, F_WRLCK)) {
+            // El mismo algoritmo que -r: First Fit en la lista en memoria o al final del archivo
+            served_refresh(served);
+            int file_size = file_stat.st_size;
+            int entries_delta = 1;
+            int start_position = take_free_space(served->archive, served->free_spaces, file_size + sizeof(FileInfo), &entries_delta);
+            fflush(served->archive);
+            if (start_position == -1) {
+                struct stat archive_stat;
+                fstat(archive_fd, &archive_stat);
+                start_position = archive_stat.st_size;
+                preallocate_range(archive_fd, start_position, file_size + sizeof(FileInfo));
+            }
+            FileInfo file_info;
+            memset(&file_info, 0, sizeof(FileInfo));
+            strncpy(file_info.filename, argument, 255);
+            file_info.filename[255 - 1] = '\0';
+            file_info.file_size = file_size;
+            file_info.status = ACTIVE;
+            file_info.start_position = start_position + sizeof(FileInfo);
+            file_info.mode = file_stat.st_mode & 07777;
+            file_info.mtime = file_stat.st_mtime;
+            if (!copy_range(file_fd, 0, archive_fd, file_info.start_position, file_size)) {
+                // take_free_space ya cambió la lista en memoria y escribió una cabecera de relleno:
+                // se descarta el final escrito a medias y se vuelve a cargar el estado del disco
+                if (file_info.start_position - (int)sizeof(FileInfo) >= served->loaded_size) {
+                    ftruncate(archive_fd, file_info.start_position - sizeof(FileInfo));
+                }
+                served_load(served);
+                dprintf(client->client_fd, "ERR error al copiar: %s\n", argument);
+            } else {
+                // Publicar la cabecera y después actualizar metadata y espacios libres
+                pwrite(archive_fd, &file_info, sizeof(FileInfo), start_position);
+                served->metadata.num_files += entries_delta;
+                pwrite(archive_fd, &served->metadata, sizeof(ArchiveMetadata), METADATA_POSITION);
+                pwrite(archive_fd, served->free_spaces, sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, sizeof(int));
+                served_add(served, &file_info);
+                dprintf(client->client_fd, "OK\n");
+            }
+            lock_archive_header(archive_fd, F_UNLCK);
+        } else {
+            dprintf(client->client_fd, "ERR no se pudo bloquear %s\n", served->name);
+        }
+        if (file_fd != -1) {
+            close(file_fd);
+        }
+    } else if (strcmp(command, "DELETE") == 0 && argument) {
+        if (!lock_archive_header(archive_fd, F_WRLCK)) {
+            dprintf(client->client_fd, "ERR no se pudo bloquear %s\n", served->name);
+        } else {
+            // Otro proceso pudo cambiar el archivo antes del bloqueo: buscar con el estado del disco
+            served_refresh(served);
+            int m = served_find(served, argument);
+            if (m == -1) {
+                dprintf(client->client_fd, "ERR no encontrado: %s\n", argument);
+            } else {
+                // Igual que --delete: marcar, liberar bloques y registrar el espacio libre
+                FileInfo file_info = served->members[m];
+                file_info.status = DELETED;
+                pwrite(archive_fd, &file_info, sizeof(FileInfo), file_info.start_position - sizeof(FileInfo));
+                punch_hole(archive_fd, file_info.start_position, file_info.file_size);
+                FreeSpaceInfo new_free_space;
+                new_free_space.start_position = file_info.start_position - sizeof(FileInfo);
+                new_free_space.size = file_info.file_size + sizeof(FileInfo);
+                insert_and_combine_free_space(served->free_spaces, new_free_space);
+                pwrite(archive_fd, served->free_spaces, sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, sizeof(int));
+                served_remove(served, m);
+                dprintf(client->client_fd, "OK\n");
+            }
+            lock_archive_header(archive_fd, F_UNLCK);
+        }
+    } else {
+        dprintf(client->client_fd, "ERR solicitud no válida: %s\n", command);
+    }
 
-    for (int i = 0; i < metadata.num_files; i++) {
-        FileInfo file_info;
-        fread(&file_info, sizeof(FileInfo), 1, archive);
+    // Los cambios propios no obligan a recargar en la próxima solicitud
+    struct stat archive_stat;
+    fstat(archive_fd, &archive_stat);
+    served->loaded_mtime = archive_stat.st_mtim;
+    served->loaded_size = archive_stat.st_size;
+    pthread_mutex_unlock(&served->lock);
+}
 
-        if (file_info.status == ACTIVE) {
-            active_files_count++;
+void *serve_client_task(void *argument) {
+    ServeClient *client = argument;
+    FILE *input = fdopen(client->client_fd, "r");
+    char line[SERVE_MAX_LINE];
+    while (input && fgets(line, sizeof(line), input)) {
+        serve_request(client, line);
+    }
+    if (input) {
+        fclose(input);
+    } else {
+        close(client->client_fd);
+    }
+    free(client);
+    return NULL;
+}
 
-            char *buffer = malloc(sizeof(FileInfo) + file_info.file_size);
-            
-            // Leer FileInfo y contenido juntos
-            fseek(archive, file_info.start_position - sizeof(FileInfo), SEEK_SET);
-            fread(buffer, sizeof(FileInfo) + file_info.file_size, 1, archive);
-            
-            // Actualizar la posición de inicio
-            ((FileInfo*)buffer)->start_position = write_position + sizeof(FileInfo);
+void serve(
+    const char *socket_path, // Ruta del socket Unix
+    char *archives[], // Archivos tar a mantener abiertos
+    int num_archives // Número de archivos tar
+) {
+    if (num_archives > SERVE_MAX_ARCHIVES) {
+        printf("Se pueden servir como máximo %d archivos.\n", SERVE_MAX_ARCHIVES);
+        return;
+    }
+    // Abrir los archivos y cargar sus cabeceras una sola vez
+    ServedArchive *served = calloc(num_archives, sizeof(ServedArchive));
+    for (int i = 0; i < num_archives; i++) {
+        snprintf(served[i].name, sizeof(served[i].name), "%s", archives[i]);
+        if (reject_volume_manifest(archives[i])) {
+            return;
+        }
+        served[i].archive = fopen(archives[i], "rb+");
+        pthread_mutex_init(&served[i].lock, NULL);
+        // Sin búfer de stdio: otros procesos cambian el archivo y las recargas deben leer el disco, no el búfer
+        if (served[i].archive) {
+            setvbuf(served[i].archive, NULL, _IONBF, 0);
+        }
+        if (!served[i].archive || !check_archive_format(fileno(served[i].archive), archives[i], NULL) || !served_load(&served[i])) {
+            printf("Error al abrir el archivo %s\n", archives[i]);
+            return;
+        }
+    }
 
-            // Escribir FileInfo y contenido juntos en la nueva posición
-            fseek(archive, write_position, SEEK_SET);
-            fwrite(buffer, sizeof(FileInfo) + file_info.file_size, 1, archive);
+    int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path);
+    unlink(socket_path);
+    if (server_fd == -1 || bind(server_fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(server_fd, 64) == -1) {
+        printf("Error al crear el socket %s: %s\n", socket_path, strerror(errno));
+        return;
+    }
+    // Un cliente que cierra la conexión a mitad de una respuesta no debe terminar el proceso
+    signal(SIGPIPE, SIG_IGN);
+    printf("Sirviendo %d archivos en %s.\n", num_archives, socket_path);
+    fflush(stdout);
+
+    // Un hilo por conexión; cada archivo se protege con su propio mutex
+    while (true) {
+        int client_fd = accept(server_fd, NULL, NULL);
+        if (client_fd == -1) {
+            if (errno == EINTR) continue;
+            printf("Error al aceptar conexión: %s\n", strerror(errno));
+            break;
+        }
+        ServeClient *client = malloc(sizeof(ServeClient));
+        client->client_fd = client_fd;
+        client->archives = served;
+        client->num_archives = num_archives;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serve_client_task, client) == 0) {
+            pthread_detach(thread);
+        } else {
+            serve_client_task(client);
+        }
+    }
+    close(server_fd);
+    unlink(socket_path);
+}
 
-            free(buffer);
+unsigned char churn_byte(int slot, int version, int offset) {
+    // Contenido determinista por archivo y versión, para validar sin guardar copias
+    unsigned int value = (slot * 2654435761u) ^ (version * 40503u) ^ (offset * 2246822519u);
+    value ^= value >> 15;
+    value *= 2246822519u;
+    value ^= value >> 13;
+    return (unsigned char)value;
+}
 
-            write_position += sizeof(FileInfo) + file_info.file_size;
-        }
+void churn_write_member(
+    const char *name, // Ruta del archivo simulado
+    int slot, // Índice del archivo simulado
+    const ChurnMember *member // Estado esperado del archivo
+) {
+    FILE *file = fopen(name, "wb");
+    if (!file) {
+        printf("Error al abrir el archivo %s\n", name);
+        return;
+    }
+    unsigned char *buffer = malloc(member->size > 0 ? member->size : 1);
+    for (int i = 0; i < member->size; i++) {
+        buffer[i] = churn_byte(slot, member->version, i);
+    }
+    fwrite(buffer, member->size, 1, file);
+    free(buffer);
+    fclose(file);
+}
 
-        fseek(archive, file_info.start_position + file_info.file_size, SEEK_SET);
+bool churn_validate(
+    const char *archive_name, // Nombre del archivo tar
+    const ChurnMember members[CHURN_POOL_SIZE], // Estado esperado de cada archivo
+    ChurnStats *stats // Estructura donde se guardan las métricas
+) {
+    memset(stats, 0, sizeof(ChurnStats));
+    FILE *archive = fopen(archive_name, "rb");
+    if (!archive) {
+        printf("Error al abrir el archivo %s\n", archive_name);
+        stats->errors = 1;
+        return false;
     }
-    // Actualizar metadatos y lista de espacios libres si es necesario.
-    metadata.num_files = active_files_count;
-    fseek(archive, sizeof(int) + sizeof(FreeSpaceInfo) * MAX_FREE_SPACES, SEEK_SET);
-    fwrite(&metadata, sizeof(ArchiveMetadata), 1, archive);
+    fseek(archive, 0, SEEK_END);
+    stats->archive_size = ftell(archive);
 
     FreeSpaceInfo free_spaces[MAX_FREE_SPACES];
-    memset(&free_spaces, 0, sizeof(FreeSpaceInfo) * MAX_FREE_SPACES);
-    fseek(archive, sizeof(int), SEEK_SET);
-    fwrite(&free_spaces, sizeof(FreeSpaceInfo), MAX_FREE_SPACES, archive);
-
-    // Redimensionar el archivo al final de la escritura
-    ftruncate(fileno(archive), write_position);
+    load_free_spaces(archive, free_spaces);
+    for (int i = 0; i < MAX_FREE_SPACES; i++) {
+        if (free_spaces[i].size > 0) {
+            stats->free_entries++;
+            stats->free_bytes += free_spaces[i].size;
+        }
+    }
 
-    if (verbose_level >= VERBOSE_SIMPLE) {
-        printf("Defragmentación completada exitosamente para el archivo %s.\n", archive_name);
+    FileInfo *file_infos;
+    int num_file_infos = load_file_infos(archive, &file_infos, false);
+    int seen[CHURN_POOL_SIZE];
+    memset(seen, 0, sizeof(seen));
+    unsigned char *buffer = malloc(CHURN_MAX_FILE_SIZE);
+    for (int i = 0; i < num_file_infos; i++) {
+        FileInfo *file_info = &file_infos[i];
+        if (file_info->status != ACTIVE) {
+            continue;
+        }
+        stats->live_bytes += sizeof(FileInfo) + file_info->file_size;
+        // Los nombres incluyen el directorio temporal de la simulación
+        const char *base_name = strrchr(file_info->filename, '/') ? strrchr(file_info->filename, '/') + 1 : file_info->filename;
+        int slot = -1;
+        if (sscanf(base_name, "churn_%d.dat", &slot) != 1 || slot < 0 || slot >= CHURN_POOL_SIZE) {
+            printf("\tArchivo inesperado en el archivo: %s\n", file_info->filename);
+            stats->errors++;
+            continue;
+        }
+        seen[slot]++;
+        if (!members[slot].active || file_info->file_size != members[slot].size) {
+            printf("\tArchivo %s: se esperaba %s de %d bytes, hay %d bytes activos.\n", file_info->filename,
+                   members[slot].active ? "activo" : "borrado", members[slot].size, file_info->file_size);
+            stats->errors++;
+            continue;
+        }
+        fseek(archive, file_info->start_position, SEEK_SET);
+        if (file_info->file_size > 0 && fread(buffer, file_info->file_size, 1, archive) != 1) {
+            printf("\tArchivo %s: no se pudo leer el contenido.\n", file_info->filename);
+            stats->errors++;
+            continue;
+        }
+        for (int j = 0; j < file_info->file_size; j++) {
+            if (buffer[j] != churn_byte(slot, members[slot].version, j)) {
+                printf("\tArchivo %s: contenido distinto en el byte %d.\n", file_info->filename, j);
+                stats->errors++;
+                break;
+            }
+        }
+    }
+    for (int slot = 0; slot < CHURN_POOL_SIZE; slot++) {
+        if (members[slot].active && seen[slot] != 1) {
+            printf("\tArchivo churn_%02d.dat: se esperaba una copia activa, hay %d.\n", slot, seen[slot]);
+            stats->errors++;
+        }
     }
+    // Bytes que no pertenecen a la cabecera, a archivos activos ni a la lista de espacios libres
+    stats->leaked_bytes = stats->archive_size - (long)HEADER_SIZE - stats->live_bytes - stats->free_bytes;
 
+    free(buffer);
+    free(file_infos);
     fclose(archive);
+    return stats->errors == 0;
 }
 
+void churn(
+    const char *archive_name // Nombre del archivo tar
+) {
+    // Archivo de métricas, una línea CSV por paso
+    char default_log[300];
+    snprintf(default_log, sizeof(default_log), "%s.churn.csv", archive_name);
+    const char *log_name = churn_log ? churn_log : default_log;
+    FILE *log = fopen(log_name, "w");
+    if (!log) {
+        printf("Error al abrir el archivo %s\n", log_name);
+        return;
+    }
+    fprintf(log, "step,operation,member,member_size,latency_us,archive_size,live_bytes,free_bytes,free_entries,leaked_bytes,fragmentation,errors\n");
+
+    srand(churn_seed);
+    ChurnMember members[CHURN_POOL_SIZE];
+    memset(members, 0, sizeof(members));
+
+    // Los archivos simulados se escriben en un directorio temporal propio, sin tocar los del usuario
+    char pool_dir[255];
+    snprintf(pool_dir, sizeof(pool_dir), "%s/star_churn_XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(pool_dir)) {
+        printf("Error al crear el directorio temporal %s: %s\n", pool_dir, strerror(errno));
+        fclose(log);
+        return;
+    }
+
+    // Archivo inicial con la mitad de los nombres
+    char names[CHURN_POOL_SIZE][300];
+    char *initial_files[CHURN_POOL_SIZE];
+    int num_initial = CHURN_POOL_SIZE / 2;
+    for (int slot = 0; slot < CHURN_POOL_SIZE; slot++) {
+        snprintf(names[slot], sizeof(names[slot]), "%s/churn_%02d.dat", pool_dir, slot);
+    }
+    for (int slot = 0; slot < num_initial; slot++) {
+        members[slot].active = true;
+        members[slot].size = rand() % CHURN_MAX_FILE_SIZE;
+        churn_write_member(names[slot], slot, &members[slot]);
+        initial_files[slot] = names[slot];
+    }
+    bool valid = create(archive_name, initial_files, num_initial);
+
+    double total_latency[4] = {0, 0, 0, 0};
+    int operation_count[4] = {0, 0, 0, 0};
+    const char *operation_names[4] = {"append", "delete", "update", "pack"};
+    ChurnStats stats;
+    memset(&stats, 0, sizeof(ChurnStats));
+    valid = valid && churn_validate(archive_name, members, &stats);
+
+    for (int step = 1; step <= churn_steps && valid; step++) {
+        int active_count = 0;
+        for (int slot = 0; slot < CHURN_POOL_SIZE; slot++) {
+            if (members[slot].active) active_count++;
+        }
+        // Elegir operación: añadir si no hay archivos activos, borrar o actualizar si no quedan nombres libres
+        int operation;
+        if (churn_pack_interval > 0 && step % churn_pack_interval == 0) {
+            operation = 3;
+        } else if (active_count == 0) {
+            operation = 0;
+        } else if (active_count == CHURN_POOL_SIZE) {
+            operation = 1 + rand() % 2;
+        } else {
+            operation = rand() % 3;
+        }
+        int slot = -1;
+        if (operation == 0) {
+            int pick = rand() % (CHURN_POOL_SIZE - active_count);
+            for (slot = 0; slot < CHURN_POOL_SIZE; slot++) {
+                if (!members[slot].active && pick-- == 0) break;
+            }
+        } else if (operation != 3) {
+            int pick = rand() % active_count;
+            for (slot = 0; slot < CHURN_POOL_SIZE; slot++) {
+                if (members[slot].active && pick-- == 0) break;
+            }
+        }
+        if (operation == 0 || operation == 2) {
+            members[slot].version++;
+            members[slot].size = rand() % CHURN_MAX_FILE_SIZE;
+            churn_write_member(names[slot], slot, &members[slot]);
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        switch (operation) {
+            case 0:
+                if (concurrent_mode) {
+                    append_concurrent(archive_name, names[slot]);
+                } else {
+                    append(archive_name, names[slot]);
+                }
+                members[slot].active = true;
+                break;
+            case 1:
+                delete(archive_name, names[slot]);
+                members[slot].active = false;
+                break;
+            case 2:
+                update(archive_name, names[slot]);
+                break;
+            case 3:
+                defragment(archive_name);
+                break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double latency_us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+        total_latency[operation] += latency_us;
+        operation_count[operation]++;
+
+        // Validar todo el contenido después de cada paso
+        valid = churn_validate(archive_name, members, &stats);
+        long data_bytes = stats.archive_size - (long)HEADER_SIZE;
+        fprintf(log, "%d,%s,%s,%d,%.1f,%ld,%ld,%ld,%d,%ld,%.4f,%d\n", step, operation_names[operation],
+                slot >= 0 ? names[slot] + strlen(pool_dir) + 1 : "", slot >= 0 ? members[slot].size : 0, latency_us,
+                stats.archive_size, stats.live_bytes, stats.free_bytes, stats.free_entries, stats.leaked_bytes,
+                data_bytes > 0 ? (double)(data_bytes - stats.live_bytes) / data_bytes : 0.0, stats.errors);
+        if (!valid) {
+            printf("Validación fallida en el paso %d (%s %s).\n", step, operation_names[operation], slot >= 0 ? names[slot] : "");
+        }
+    }
+    fclose(log);
+
+    // Resumen
+    printf("Simulación de envejecimiento de %s: %s.\n", archive_name, valid ? "contenido válido en todos los pasos" : "se detectaron errores");
+    for (int operation = 0; operation < 4; operation++) {
+        if (operation_count[operation] > 0) {
+            printf("\t%s: %d operaciones, latencia media %.1f us.\n", operation_names[operation],
+                   operation_count[operation], total_latency[operation] / operation_count[operation]);
+        }
+    }
+    printf("\tTamaño final: %ld bytes, activos: %ld, libres: %ld en %d/%d espacios, perdidos: %ld.\n",
+           stats.archive_size, stats.live_bytes, stats.free_bytes, stats.free_entries, MAX_FREE_SPACES, stats.leaked_bytes);
+    printf("\tMétricas por paso escritas en %s.\n", log_name);
 
+    for (int slot = 0; slot < CHURN_POOL_SIZE; slot++) {
+        unlink(names[slot]);
+    }
+    rmdir(pool_dir);
+}
 
+bool parse_setting_option(
+    const char *option // Opción de la línea de comandos
+) {
+    // Ajustes que modifican el comportamiento de las operaciones, no son operaciones
+    if (strcmp(option, "--concurrent") == 0) {
+        concurrent_mode = true;
+        return true;
+    }
+    if (strncmp(option, "--volumes=", 10) == 0) {
+        num_volumes = atoi(option + 10);
+        return true;
+    }
+    if (strncmp(option, "--volume-size=", 14) == 0) {
+        volume_size = atol(option + 14);
+        return true;
+    }
+    if (strncmp(option, "--volume-dirs=", 14) == 0) {
+        volume_dirs = (char *)option + 14;
+        return true;
+    }
+    if (strncmp(option, "--on-conflict=", 14) == 0) {
+        if (strcmp(option + 14, "replace") == 0) {
+            conflict_policy = CONFLICT_REPLACE;
+        } else if (strcmp(option + 14, "rename") == 0) {
+            conflict_policy = CONFLICT_RENAME;
+        } else {
+            conflict_policy = CONFLICT_SKIP;
+        }
+        return true;
+    }
+    if (strncmp(option, "--limit-rate=", 13) == 0) {
+        // Acepta sufijos K, M y G
+        char *suffix;
+        rate_limit_bytes = strtol(option + 13, &suffix, 10);
+        if (*suffix == 'K' || *suffix == 'k') rate_limit_bytes *= 1024;
+        if (*suffix == 'M' || *suffix == 'm') rate_limit_bytes *= 1024 * 1024;
+        if (*suffix == 'G' || *suffix == 'g') rate_limit_bytes *= 1024L * 1024 * 1024;
+        return true;
+    }
+    if (strncmp(option, "--limit-iops=", 13) == 0) {
+        rate_limit_iops = atol(option + 13);
+        return true;
+    }
+    if (strcmp(option, "--drop-cache") == 0) {
+        drop_cache = true;
+        return true;
+    }
+    if (strncmp(option, "--ioprio=", 9) == 0) {
+        io_priority = (char *)option + 9;
+        return true;
+    }
+    if (strcmp(option, "--preserve-permissions") == 0) {
+        preserve_permissions = true;
+        return true;
+    }
+    if (strncmp(option, "--threads=", 10) == 0) {
+        num_threads = atoi(option + 10);
+        return true;
+    }
+    if (strncmp(option, "--steps=", 8) == 0) {
+        churn_steps = atoi(option + 8);
+        return true;
+    }
+    if (strncmp(option, "--seed=", 7) == 0) {
+        churn_seed = strtoul(option + 7, NULL, 10);
+        return true;
+    }
+    if (strncmp(option, "--pack-every=", 13) == 0) {
+        churn_pack_interval = atoi(option + 13);
+        return true;
+    }
+    if (strncmp(option, "--churn-log=", 12) == 0) {
+        churn_log = (char *)option + 12;
+        return true;
+    }
+    return false;
+}
 
 void showValidOptions() {
     printf("Uso: ./star <opciones> <archivoSalida> <archivo1> <archivo2> ... <archivoN>\n\n");
@@ -748,18 +3320,41 @@ void showValidOptions() {
 
     printf("Opciones principales:\n");
     printf("\t-c, --create : Crea un nuevo archivo comprimido con los archivos especificados.\n");
-    printf("\t-x, --extract : Extrae los contenidos de un archivo comprimido a la ubicación actual.\n");
+    printf("\t-x, --extract : Extrae los contenidos de un archivo comprimido a la ubicación actual, creando los directorios y restaurando permisos y fechas. Si se indican archivos, solo extrae esos.\n");
     printf("\t-t, --list : Lista los contenidos de un archivo comprimido, mostrando detalles de cada archivo contenido.\n");
     printf("\t--delete : Borra un archivo o archivos específicos dentro de un archivo comprimido.\n");
     printf("\t-u, --update : Actualiza el contenido del archivo comprimido con nuevos archivos o versiones de archivos existentes.\n");
     printf("\t-v, --verbose : Proporciona un reporte detallado de las acciones que se están realizando. Use -v para un reporte básico y -vv para un reporte detallado.\n");
     printf("\t-r, --append : Agrega contenido a un archivo comprimido sin eliminar o modificar el contenido existente.\n");
-    printf("\t-p, --pack : Desfragmenta el contenido del archivo comprimido, eliminando espacios vacíos y optimizando el almacenamiento.\n\n");
+    printf("\t-p, --pack : Desfragmenta el contenido del archivo comprimido, eliminando espacios vacíos y optimizando el almacenamiento.\n");
+    printf("\t-d, --diff : Compara los archivos del archivo comprimido con los del disco (tamaño, contenido, permisos y fecha) y muestra solo las diferencias, incluidos los archivos pedidos que no están en el archivo. Si se indican archivos, solo compara esos. Termina con estado 1 si hay diferencias.\n");
+    printf("\t-A, --catenate : Añade al final del archivo comprimido los archivos de otros archivos comprimidos, copiando el contenido dentro del kernel y omitiendo los borrados.\n");
+    printf("\t--cat : Escribe en la salida estándar solo el rango pedido de cada archivo, indicado como archivo[:posición[:largo]], sin extraer el archivo completo. Termina con estado 1 si algún archivo no se pudo leer.\n");
+    printf("\t--serve[=SOCKET] : Mantiene abiertos los archivos indicados con sus cabeceras en memoria y atiende solicitudes por un socket Unix (por defecto <archivo>.sock).\n");
+    printf("\t\tSolicitudes, una por línea: LIST <archivo> | CAT <archivo> <nombre> [posición [largo]] | APPEND <archivo> <ruta> | DELETE <archivo> <nombre>. Respuesta: OK o ERR.\n");
+    printf("\t--churn : Simula el envejecimiento del archivo con borrados, añadidos y actualizaciones aleatorias, valida el contenido en cada paso y guarda métricas de fragmentación y latencia en CSV.\n\n");
+
+    printf("Ajustes:\n");
+    printf("\t--concurrent : Con -r/--append, reserva el final del archivo con un bloqueo breve y copia el contenido en paralelo con otros procesos que añaden al mismo archivo.\n");
+    printf("\t--on-conflict=skip|replace|rename : Con -A, qué hacer si un archivo ya existe en el destino: omitirlo (por defecto), reemplazarlo o añadirlo con un sufijo numérico.\n");
+    printf("\t--limit-rate=BYTES : Limita la E/S de las copias a BYTES por segundo (acepta K, M y G), para no saturar el disco.\n");
+    printf("\t--limit-iops=N : Limita las copias a N operaciones de E/S por segundo.\n");
+    printf("\t--drop-cache : Descarta del caché de páginas lo que se copia, para no desplazar los datos de otros procesos.\n");
+    printf("\t--ioprio=idle|best-effort[:N]|realtime[:N] : Prioridad de E/S del proceso.\n");
+    printf("\t--preserve-permissions : Con -x, restaura también los bits setuid, setgid y sticky guardados en el archivo.\n");
+    printf("\t--threads=N : Con -c, calcula la posición de cada archivo antes de copiar y escribe el contenido desde N hilos. Con -d, compara N archivos a la vez.\n");
+    printf("\t--volumes=N : Con -c, divide el archivo en N volúmenes escritos en paralelo; el archivo indicado guarda el manifiesto. -t y -x leen todos los volúmenes.\n");
+    printf("\t--volume-size=BYTES : Con -c, crea tantos volúmenes como sean necesarios sin superar BYTES cada uno.\n");
+    printf("\t--volume-dirs=DIR1:DIR2 : Reparte los volúmenes entre los directorios indicados (relativos al manifiesto), por ejemplo uno por disco.\n");
+    printf("\t--steps=N, --seed=N : Con --churn, número de pasos y semilla de la secuencia aleatoria.\n");
+    printf("\t--pack-every=N : Con --churn, ejecuta --pack cada N pasos para comparar estrategias de compactación.\n");
+    printf("\t--churn-log=ARCHIVO : Con --churn, archivo CSV de métricas (por defecto <archivo>.churn.csv).\n\n");
 
     printf("Ejemplos de uso:\n");
     printf("\t./star -c archivoSalida.tar archivo1.txt archivo2.txt\n");
     printf("\t./star --list archivoSalida.tar\n");
     printf("\t./star -v --delete archivoSalida.tar archivo1.txt\n");
+    printf("\t./star --cat archivoSalida.tar registro.log:1048576:4096\n");
 
 }
 
@@ -789,7 +3384,7 @@ int main(int argc, char *argv[]) {
             optionsLenght = strlen(argv[i]);
 
             for (int j = 1; j < optionsLenght; j++) {
-                 if (!(strchr("cvxturp", argv[i][j]))) {
+                 if (!(strchr("cvxturpdA", argv[i][j]))) {
                     printf("Opción no válida: %c\n", argv[i][j]);
                     printf("Para ver una lista de comandos disponibles, ingrese --help.\n");
                     return 1;
@@ -803,6 +3398,10 @@ int main(int argc, char *argv[]) {
                 }
             }
         }
+        parse_setting_option(argv[i]);
+        if (strcmp(argv[i], "--cat") == 0) {
+            raw_output = true;
+        }
         if (strcmp(argv[i], "--verbose") == 0) {
             if (verbose_level == VERBOSE_NONE) {
                 verbose_level = VERBOSE_SIMPLE;
@@ -817,6 +3416,10 @@ int main(int argc, char *argv[]) {
         printf("Uso: ./star <opciones> <archivoSalida> <archivo1> <archivo2> ... <archivoN>\n");
         return 1;
     }
+    // Aplicar la prioridad de E/S antes de cualquier operación
+    if (io_priority && !apply_io_priority(io_priority)) {
+        return 1;
+    }
     //get file name
     archive_name = argv[options_count + 1];
     //get files name
@@ -826,12 +3429,18 @@ int main(int argc, char *argv[]) {
     // Verificar opciones
     for(int i = 0; i < options_count; i++){
        if (argv[i+1][1] == '-'){
-            if (strcmp(argv[i+1], "--create") == 0) {
+            if (parse_setting_option(argv[i+1]) || strcmp(argv[i+1], "--verbose") == 0) {
+                // Ajuste ya procesado
+            } else if (strcmp(argv[i+1], "--create") == 0) {
                 printf("create\n");
-                create(archive_name, files_name, num_files);
+                if (num_volumes > 1 || volume_size > 0) {
+                    create_volumes(archive_name, files_name, num_files);
+                } else {
+                    create(archive_name, files_name, num_files);
+                }
             } else if (strcmp(argv[i+1], "--extract") == 0){
                 printf("extract\n");
-                extractAll(archive_name);
+                extract(archive_name, files_name, num_files);
             } else if (strcmp(argv[i+1], "--list") == 0){
                 printf("list\n");
                 list(archive_name);
@@ -844,10 +3453,37 @@ int main(int argc, char *argv[]) {
                 update(archive_name,files_name[0]);
             } else if (strcmp(argv[i+1], "--append") == 0){
                 printf("append\n");
-                append(archive_name, files_name[0]);
+                if (concurrent_mode) {
+                    append_concurrent(archive_name, files_name[0]);
+                } else {
+                    append(archive_name, files_name[0]);
+                }
             } else if (strcmp(argv[i+1], "--pack") == 0){
                 printf("pack\n");
                 defragment(archive_name);
+            } else if (strcmp(argv[i+1], "--diff") == 0){
+                printf("diff\n");
+                if (diff(archive_name, files_name, num_files) > 0) {
+                    exit_status = 1;
+                }
+            } else if (strcmp(argv[i+1], "--catenate") == 0 || strcmp(argv[i+1], "--concatenate") == 0){
+                printf("catenate\n");
+                catenate(archive_name, files_name, num_files);
+            } else if (strcmp(argv[i+1], "--cat") == 0){
+                for (int j = 0; j < num_files; j++) {
+                    if (!cat(archive_name, files_name[j])) {
+                        exit_status = 1;
+                    }
+                }
+            } else if (strncmp(argv[i+1], "--serve", 7) == 0 && (argv[i+1][7] == '\0' || argv[i+1][7] == '=')){
+                // --serve=SOCKET; sin ruta se usa <archivo>.sock
+                char default_socket[300];
+                snprintf(default_socket, sizeof(default_socket), "%s.sock", archive_name);
+                printf("serve\n");
+                serve(argv[i+1][7] == '=' ? argv[i+1] + 8 : default_socket, &argv[options_count + 1], num_files + 1);
+            } else if (strcmp(argv[i+1], "--churn") == 0){
+                printf("churn\n");
+                churn(archive_name);
             }else if(strcmp(argv[i+1], "--help")==0){
                 showValidOptions();
             } else {
@@ -859,11 +3495,15 @@ int main(int argc, char *argv[]) {
                 switch (argv[i+1][j]){
                     case 'c':
                         printf("create\n");
-                        create(archive_name, files_name, num_files);
+                        if (num_volumes > 1 || volume_size > 0) {
+                            create_volumes(archive_name, files_name, num_files);
+                        } else {
+                            create(archive_name, files_name, num_files);
+                        }
                         break;
                     case 'x':
                         printf("extract\n");
-                        extractAll(archive_name);
+                        extract(archive_name, files_name, num_files);
                         break;
                     case 't':
                         printf("list\n");
@@ -875,10 +3515,24 @@ int main(int argc, char *argv[]) {
                         break;
                     case 'r':
                         printf("append\n");
-                        append(archive_name, files_name[0]);
+                        if (concurrent_mode) {
+                            append_concurrent(archive_name, files_name[0]);
+                        } else {
+                            append(archive_name, files_name[0]);
+                        }
                         break;
                     case 'v':
                         break;
+                    case 'd':
+                        printf("diff\n");
+                        if (diff(archive_name, files_name, num_files) > 0) {
+                            exit_status = 1;
+                        }
+                        break;
+                    case 'A':
+                        printf("catenate\n");
+                        catenate(archive_name, files_name, num_files);
+                        break;
                     case 'p':
                         printf("pack\n");
                         defragment(archive_name);
@@ -894,6 +3548,11 @@ int main(int argc, char *argv[]) {
 
 
     }
+    // Reportar el rendimiento alcanzado cuando hay límites de E/S o reportes detallados
+    if (rate_limit_bytes > 0 || rate_limit_iops > 0 || verbose_level >= VERBOSE_SIMPLE) {
+        report_io_throughput(raw_output ? stderr : stdout);
+    }
+    if (!raw_output) {
         switch (verbose_level) {
         case VERBOSE_NONE:
             printf("Nivel de detalle: Ninguno\n");
@@ -904,6 +3563,7 @@ int main(int argc, char *argv[]) {
         case VERBOSE_DETAILED:
             printf("Nivel de detalle: Detallado\n");
             break;
+        }
     }
-    return 0;
+    return exit_status;
 }
\ No newline at end of file